@@ -1,5 +1,6 @@
 #include "archive.h"
 
+#include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <fstream>
@@ -17,6 +18,18 @@ using namespace AhoViewer;
 #include "zip.h"
 #endif // HAVE_LIBZIP
 
+namespace
+{
+    // Stops the read ahead threads while the archive's read_entry still exists
+    template<typename T>
+    class ArchiveImpl final : public T
+    {
+    public:
+        ArchiveImpl(const std::string& path, const std::string& ex_dir) : T(path, ex_dir) { }
+        ~ArchiveImpl() override { this->stop_read_ahead(); }
+    };
+}
+
 const std::vector<std::string> Archive::MimeTypes = {
 #ifdef HAVE_LIBZIP
     "application/x-zip", "application/x-zip-compressed", "application/zip",   "application/cbz",
@@ -73,12 +86,12 @@ std::unique_ptr<Archive> Archive::create(const std::string& path, const std::str
         {
 #ifdef HAVE_LIBZIP
             if (type == Type::ZIP)
-                return std::make_unique<Zip>(path, dir);
+                return std::make_unique<ArchiveImpl<Zip>>(path, dir);
 #endif // HAVE_LIBZIP
 
 #ifdef HAVE_LIBUNRAR
             if (type == Type::RAR)
-                return std::make_unique<Rar>(path, dir);
+                return std::make_unique<ArchiveImpl<Rar>>(path, dir);
 #endif // HAVE_LIBUNRAR
         }
     }
@@ -118,5 +131,139 @@ Archive::Archive(std::string path, std::string ex_dir)
 
 Archive::~Archive()
 {
+    stop_read_ahead();
     TempDir::get_instance().remove_dir(m_ExtractedPath);
 }
+
+bool Archive::read(const std::string& file, std::vector<unsigned char>& buf) const
+{
+    {
+        std::scoped_lock lock{ m_ReadAheadMutex };
+        auto it{ m_ReadAhead.find(file) };
+
+        // Copied since the cache and thumbnail threads may both want it
+        if (it != m_ReadAhead.end())
+        {
+            buf = it->second;
+            return true;
+        }
+    }
+
+    return read_entry(file, buf);
+}
+
+void Archive::read_ahead(std::vector<std::string> files)
+{
+    {
+        std::scoped_lock lock{ m_ReadAheadMutex };
+
+        for (auto it{ m_ReadAhead.begin() }; it != m_ReadAhead.end();)
+        {
+            if (std::find(files.begin(), files.end(), it->first) == files.end())
+            {
+                m_ReadAheadSize -= it->second.size();
+                it = m_ReadAhead.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        // Files being read are kept going if they're still wanted
+        for (const auto& [file, cancel] : m_ReadAheadReading)
+            if (std::find(files.begin(), files.end(), file) == files.end())
+                cancel->cancel();
+
+        files.erase(std::remove_if(files.begin(),
+                                   files.end(),
+                                   [&](const std::string& f) {
+                                       return m_ReadAhead.count(f) || m_ReadAheadReading.count(f);
+                                   }),
+                    files.end());
+
+        m_ReadAheadFiles = std::move(files);
+        ++m_ReadAheadGeneration;
+
+        if (m_ReadAheadFiles.empty() || m_ReadAheadStop)
+            return;
+
+        if (m_ReadAheadThreads.empty())
+            for (size_t i = 0; i < get_max_readers(); ++i)
+                m_ReadAheadThreads.emplace_back(&Archive::read_ahead_thread, this);
+    }
+
+    m_ReadAheadCond.notify_all();
+}
+
+void Archive::stop_read_ahead()
+{
+    {
+        std::scoped_lock lock{ m_ReadAheadMutex };
+        m_ReadAheadStop = true;
+        m_ReadAheadFiles.clear();
+
+        for (const auto& [file, cancel] : m_ReadAheadReading)
+            cancel->cancel();
+    }
+
+    m_ReadAheadCond.notify_all();
+
+    for (std::thread& t : m_ReadAheadThreads)
+        t.join();
+    m_ReadAheadThreads.clear();
+}
+
+void Archive::read_ahead_thread()
+{
+    std::unique_lock<std::mutex> lock(m_ReadAheadMutex);
+
+    while (true)
+    {
+        m_ReadAheadCond.wait(lock, [&]() { return m_ReadAheadStop || !m_ReadAheadFiles.empty(); });
+
+        if (m_ReadAheadStop)
+            break;
+
+        const std::string file{ std::move(m_ReadAheadFiles.front()) };
+        const auto cancel{ Gio::Cancellable::create() };
+        m_ReadAheadFiles.erase(m_ReadAheadFiles.begin());
+        m_ReadAheadReading.emplace(file, cancel);
+
+        const size_t space{ ReadAheadBytes - m_ReadAheadSize }, generation{ m_ReadAheadGeneration };
+        lock.unlock();
+
+        const unsigned char* data;
+        size_t size;
+        std::vector<unsigned char> buf;
+        bool read{ false }, full{ false };
+
+        // Mapped files are already in memory (or will be paged in by the kernel)
+        if (!map(file, data, size))
+        {
+            // Files that won't fit aren't decompressed just to be thrown away
+            if (get_entry_size(file) > space)
+                full = true;
+            else
+                read = read_entry(file, buf, cancel);
+        }
+
+        lock.lock();
+        m_ReadAheadReading.erase(file);
+
+        // Out of space, the files further ahead will be read when they're needed.
+        // Unless read_ahead has been given new files in the meantime
+        if (full || (read && m_ReadAheadSize + buf.size() > ReadAheadBytes))
+        {
+            if (generation == m_ReadAheadGeneration)
+                m_ReadAheadFiles.clear();
+            continue;
+        }
+
+        if (!read || cancel->is_cancelled())
+            continue;
+
+        m_ReadAheadSize += buf.size();
+        m_ReadAhead.emplace(file, std::move(buf));
+    }
+}
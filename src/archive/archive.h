@@ -2,8 +2,13 @@
 
 #include "../image.h"
 
+#include <condition_variable>
 #include <functional>
+#include <mutex>
 #include <sigc++/sigc++.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace AhoViewer
 {
@@ -35,8 +40,13 @@ namespace AhoViewer
 
             void save(const std::string& path);
 
+            const std::string& get_archive_file_path() const { return m_ArchiveFilePath; }
+
         private:
             void extract_file();
+            bool read_file(std::vector<unsigned char>& buf,
+                           const unsigned char*& data,
+                           size_t& size) const;
 
             // The path to the image file inside of m_Archive
             std::string m_ArchiveFilePath;
@@ -45,6 +55,7 @@ namespace AhoViewer
 
         virtual ~Archive();
 
+        // Archives are always created through here, see ArchiveImpl in archive.cc
         static bool is_valid(const std::string& path);
         static bool is_valid_extension(const std::string& path);
         static std::unique_ptr<Archive> create(const std::string& path,
@@ -54,6 +65,23 @@ namespace AhoViewer
         virtual bool has_valid_files(const FileType t) const                 = 0;
         virtual std::vector<std::string> get_entries(const FileType t) const = 0;
 
+        // Decompresses file into buf without writing it to disk, extract is only used
+        // when something needs a path to the file (playing a video).
+        // Files that have already been read ahead are returned from memory
+        bool read(const std::string& file, std::vector<unsigned char>& buf) const;
+
+        // Queues files to be decompressed in the given order on background threads so read
+        // can return them right away. This replaces whatever was queued before and never
+        // waits for the threads, anything read ahead earlier that is not in files is dropped
+        void read_ahead(std::vector<std::string> files);
+
+        // Points data at file inside a memory mapping of the archive that lives as long as the
+        // archive does. Only possible for files that are stored without compression
+        virtual bool map(const std::string&, const unsigned char*&, size_t&) const
+        {
+            return false;
+        }
+
         const std::string get_path() const { return m_Path; }
         const std::string get_extracted_path() const { return m_ExtractedPath; }
 
@@ -62,12 +90,41 @@ namespace AhoViewer
     protected:
         Archive(std::string path, std::string ex_dir);
 
+        // c is only set when reading ahead, the read gives up as soon as it is cancelled
+        virtual bool read_entry(const std::string& file,
+                                std::vector<unsigned char>& buf,
+                                const Glib::RefPtr<Gio::Cancellable>& c = {}) const = 0;
+        // Decompressed size of file, 0 when it isn't known without decompressing it
+        virtual size_t get_entry_size(const std::string&) const { return 0; }
+        // Number of entries that can be decompressed at the same time, one read ahead
+        // thread is started for each
+        virtual size_t get_max_readers() const { return 1; }
+
+        // Stops the read ahead threads, they use read_entry so this must run before the
+        // subclass is destroyed
+        void stop_read_ahead();
+
         std::string m_Path, m_ExtractedPath;
 
     private:
         static Type get_type(const std::string& path);
 
+        void read_ahead_thread();
+
         // Matches the largest archive MagicSize
         static constexpr int MagicSize{ 6 };
+        // Maximum size of all the files in m_ReadAhead
+        static constexpr size_t ReadAheadBytes{ 128 * 1024 * 1024 };
+
+        std::unordered_map<std::string, std::vector<unsigned char>> m_ReadAhead;
+        // Files still waiting to be read, and the ones being read right now which are
+        // cancelled when read_ahead no longer wants them
+        std::vector<std::string> m_ReadAheadFiles;
+        std::unordered_map<std::string, Glib::RefPtr<Gio::Cancellable>> m_ReadAheadReading;
+        size_t m_ReadAheadSize{ 0 }, m_ReadAheadGeneration{ 0 };
+        bool m_ReadAheadStop{ false };
+        std::vector<std::thread> m_ReadAheadThreads;
+        std::condition_variable m_ReadAheadCond;
+        mutable std::mutex m_ReadAheadMutex;
     };
 }
@@ -3,6 +3,8 @@
 #include <giomm.h>
 using namespace AhoViewer;
 
+#include <iostream>
+
 Archive::Image::Image(const std::string& path, const Archive& archive)
     : AhoViewer::Image(Glib::build_filename(archive.get_extracted_path(), path)),
       m_ArchiveFilePath(path),
@@ -20,8 +22,22 @@ const Glib::RefPtr<Gdk::Pixbuf>& Archive::Image::get_thumbnail(Glib::RefPtr<Gio:
 {
     if (!m_ThumbnailPixbuf)
     {
-        extract_file();
-        create_thumbnail(c, false);
+        // Videos are handed to gstreamer by path
+        if (m_IsWebM)
+        {
+            extract_file();
+            create_thumbnail(c, false);
+        }
+        else
+        {
+            std::vector<unsigned char> buf;
+            const unsigned char* data;
+            size_t size;
+
+            if (read_file(buf, data, size))
+                m_ThumbnailPixbuf =
+                    create_pixbuf_at_size(data, size, ThumbnailSize, ThumbnailSize, c);
+        }
     }
 
     return m_ThumbnailPixbuf;
@@ -29,10 +45,18 @@ const Glib::RefPtr<Gdk::Pixbuf>& Archive::Image::get_thumbnail(Glib::RefPtr<Gio:
 
 void Archive::Image::load_pixbuf(Glib::RefPtr<Gio::Cancellable> c)
 {
-    if (!m_Pixbuf)
+    if (m_IsWebM)
     {
         extract_file();
-        AhoViewer::Image::load_pixbuf(c);
+    }
+    else if (!m_Pixbuf)
+    {
+        std::vector<unsigned char> buf;
+        const unsigned char* data;
+        size_t size;
+
+        if (read_file(buf, data, size) && !c->is_cancelled())
+            load_pixbuf_from_data(data, size, c);
     }
 }
 
@@ -40,7 +64,45 @@ void Archive::Image::save(const std::string& path)
 {
     Glib::RefPtr<Gio::File> src{ Gio::File::create_for_path(m_Path) },
         dst{ Gio::File::create_for_path(path) };
-    src->copy(dst, Gio::FILE_COPY_OVERWRITE);
+
+    // Only videos have been extracted, everything else is written straight from the archive
+    if (Glib::file_test(m_Path, Glib::FILE_TEST_EXISTS))
+    {
+        src->copy(dst, Gio::FILE_COPY_OVERWRITE);
+        return;
+    }
+
+    std::vector<unsigned char> buf;
+    const unsigned char* data;
+    size_t size;
+
+    if (!read_file(buf, data, size))
+    {
+        std::cerr << "Failed to read '" << m_ArchiveFilePath << "' from '" << m_Archive.get_path()
+                  << "'" << std::endl;
+        return;
+    }
+
+    std::string etag;
+    dst->replace_contents(reinterpret_cast<const char*>(data), size, "", etag);
+}
+
+// Points data at the file's contents, either straight inside the archive's memory
+// mapping or in buf after it's been decompressed
+bool Archive::Image::read_file(std::vector<unsigned char>& buf,
+                               const unsigned char*& data,
+                               size_t& size) const
+{
+    if (m_Archive.map(m_ArchiveFilePath, data, size))
+        return true;
+
+    if (!m_Archive.read(m_ArchiveFilePath, buf))
+        return false;
+
+    data = buf.data();
+    size = buf.size();
+
+    return true;
 }
 
 void Archive::Image::extract_file()
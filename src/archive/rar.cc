@@ -9,6 +9,9 @@ using namespace AhoViewer;
 #define _UNIX
 #endif // _UNIX
 
+#include <algorithm>
+#include <iostream>
+
 #if defined(HAVE_LIBUNRAR_DLL_HPP)
 #include <libunrar/dll.hpp>
 #elif defined(HAVE_UNRAR_DLL_HPP)
@@ -45,6 +48,11 @@ std::string utf16_to_utf8(const std::wstring& s)
 
 Rar::Rar(const std::string& path, const std::string& ex_dir) : Archive::Archive(path, ex_dir) { }
 
+Rar::~Rar()
+{
+    close();
+}
+
 bool Rar::extract(const std::string& file) const
 {
     bool found = false;
@@ -94,6 +102,171 @@ bool Rar::extract(const std::string& file) const
     return found;
 }
 
+struct ReadData
+{
+    std::vector<unsigned char>& buf;
+    const Glib::RefPtr<Gio::Cancellable>& cancel;
+};
+
+// Appends each decompressed chunk of the file being tested to the buffer of the ReadData
+// passed as user_data, returning -1 stops decompressing
+static int CALLBACK read_cb(UINT msg, LPARAM user_data, LPARAM p1, LPARAM p2)
+{
+    if (msg == UCM_PROCESSDATA)
+    {
+        auto* d{ reinterpret_cast<ReadData*>(user_data) };
+        if (d->cancel && d->cancel->is_cancelled())
+            return -1;
+
+        auto* data{ reinterpret_cast<unsigned char*>(p1) };
+        d->buf.insert(d->buf.end(), data, data + p2);
+    }
+    else if (msg == UCM_NEEDPASSWORD || msg == UCM_NEEDPASSWORDW)
+    {
+        return -1;
+    }
+
+    return 1;
+}
+
+// Entries are read in archive order with a single handle. Solid archives can only be
+// decompressed front to back, so there every image passed on the way to the requested file
+// is decompressed anyway and kept in m_Cache. Other archives skip over them without
+// decompressing anything.
+// Seeking backwards past m_Cache starts over from the first header, which only reads
+// headers for non-solid archives but decompresses everything before the file for solid ones.
+bool Rar::read_entry(const std::string& file,
+                     std::vector<unsigned char>& buf,
+                     const Glib::RefPtr<Gio::Cancellable>& c) const
+{
+    std::scoped_lock lock{ m_Mutex };
+
+    auto it{ std::find_if(
+        m_Cache.begin(), m_Cache.end(), [&](const auto& e) { return e.first == file; }) };
+    if (it != m_Cache.end())
+    {
+        buf = it->second;
+        return true;
+    }
+
+    if (auto p{ m_Positions.find(file) }; p != m_Positions.end() && p->second < m_Position)
+        close();
+
+    if (!m_Handle && !open())
+        return false;
+
+    RARHeaderDataEx header;
+
+    while (true)
+    {
+        // Giving up between entries leaves the handle where it is for the next read
+        if (c && c->is_cancelled())
+            return false;
+
+        if (RARReadHeaderEx(m_Handle, &header) != ERAR_SUCCESS)
+            break;
+
+#ifdef _WIN32
+        std::string filename = utf16_to_utf8(header.FileNameW);
+#else  // !_WIN32
+        std::string filename = header.FileName;
+#endif // !_WIN32
+        m_Positions.emplace(filename, m_Position++);
+
+        if ((header.Flags & RHDF_DIRECTORY) ||
+            (filename != file && (!m_Solid || !Image::is_valid_extension(filename))))
+        {
+            RARProcessFile(m_Handle, RAR_SKIP, nullptr, nullptr);
+            continue;
+        }
+
+        std::vector<unsigned char> data;
+        ReadData read_data{ data, c };
+        data.reserve(static_cast<size_t>(header.UnpSizeHigh) << 32 | header.UnpSize);
+        RARSetCallback(m_Handle, read_cb, reinterpret_cast<LPARAM>(&read_data));
+
+        // RAR_TEST decompresses the file and passes the data to read_cb
+        if (RARProcessFile(m_Handle, RAR_TEST, nullptr, nullptr) != ERAR_SUCCESS)
+        {
+            // The handle can't carry on from a file that was stopped partway through
+            if (filename == file || (c && c->is_cancelled()))
+                break;
+            continue;
+        }
+
+        if (filename == file)
+        {
+            buf = data;
+            cache_entry(std::move(filename), std::move(data));
+            return true;
+        }
+
+        cache_entry(std::move(filename), std::move(data));
+    }
+
+    // Reached the end of the archive or failed to decompress the file
+    close();
+    return false;
+}
+
+bool Rar::open() const
+{
+    RAROpenArchiveDataEx archive;
+    memset(&archive, 0, sizeof(archive));
+
+#ifdef _WIN32
+    std::wstring wPath = utf8_to_utf16(m_Path);
+    archive.ArcNameW   = const_cast<wchar_t*>(wPath.c_str());
+#else  // !_WIN32
+    archive.ArcName = const_cast<char*>(m_Path.c_str());
+#endif // !_WIN32
+    archive.OpenMode = RAR_OM_EXTRACT;
+
+    m_Handle   = RAROpenArchiveEx(&archive);
+    m_Position = 0;
+    m_Solid    = m_Handle && (archive.Flags & ROADF_SOLID);
+
+    if (!m_Handle)
+        std::cerr << "RAROpenArchiveEx: Failed to open '" + m_Path + "'" << std::endl;
+
+    return m_Handle != nullptr;
+}
+
+void Rar::close() const
+{
+    if (m_Handle)
+    {
+        RARCloseArchive(m_Handle);
+        m_Handle = nullptr;
+    }
+
+    m_Position = 0;
+}
+
+// Oldest entries are dropped first, they are the furthest behind the last requested file
+void Rar::cache_entry(std::string file, std::vector<unsigned char> data) const
+{
+    if (data.size() > CacheBytes)
+        return;
+
+    m_CacheBytes += data.size();
+    m_Cache.emplace_back(std::move(file), std::move(data));
+
+    while (m_CacheBytes > CacheBytes)
+    {
+        m_CacheBytes -= m_Cache.front().second.size();
+        m_Cache.pop_front();
+    }
+}
+
+size_t Rar::get_entry_size(const std::string& file) const
+{
+    std::scoped_lock lock{ m_SizesMutex };
+    auto it{ m_Sizes.find(file) };
+
+    return it != m_Sizes.end() ? it->second : 0;
+}
+
 bool Rar::has_valid_files(const FileType t) const
 {
     return !get_entries(t).empty();
@@ -128,7 +301,11 @@ std::vector<std::string> Rar::get_entries(const FileType t) const
 #endif // !_WIN32
             if (((t & IMAGES) && Image::is_valid_extension(filename)) ||
                 ((t & ARCHIVES) && Archive::is_valid_extension(filename)))
+            {
+                std::scoped_lock lock{ m_SizesMutex };
+                m_Sizes[filename] = static_cast<size_t>(header.UnpSizeHigh) << 32 | header.UnpSize;
                 entries.push_back(std::move(filename));
+            }
 
             RARProcessFile(rar, RAR_SKIP, nullptr, nullptr);
         }
@@ -2,13 +2,16 @@
 
 #include "archive.h"
 
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
 namespace AhoViewer
 {
     class Rar : public Archive
     {
     public:
-        Rar(const std::string& path, const std::string& ex_dir);
-        ~Rar() override = default;
+        ~Rar() override;
 
         bool extract(const std::string& file) const override;
         bool has_valid_files(const FileType t) const override;
@@ -16,5 +19,34 @@ namespace AhoViewer
 
         static constexpr int MagicSize{ 6 };
         static constexpr char Magic[MagicSize]{ 'R', 'a', 'r', '!', 0x1A, 0x07 };
+
+    protected:
+        Rar(const std::string& path, const std::string& ex_dir);
+
+        bool read_entry(const std::string& file,
+                        std::vector<unsigned char>& buf,
+                        const Glib::RefPtr<Gio::Cancellable>& c = {}) const override;
+        size_t get_entry_size(const std::string& file) const override;
+
+    private:
+        // Opens m_Handle at the first header
+        bool open() const;
+        void close() const;
+        void cache_entry(std::string file, std::vector<unsigned char> data) const;
+
+        // Maximum size of all decompressed entries kept in m_Cache
+        static constexpr size_t CacheBytes{ 64 * 1024 * 1024 };
+
+        // Used by read, m_Position is the index of the next header m_Handle will read
+        mutable void* m_Handle{ nullptr };
+        mutable size_t m_Position{ 0 }, m_CacheBytes{ 0 };
+        mutable bool m_Solid{ false };
+        mutable std::unordered_map<std::string, size_t> m_Positions;
+        mutable std::deque<std::pair<std::string, std::vector<unsigned char>>> m_Cache;
+        mutable std::mutex m_Mutex;
+
+        // Decompressed size of each entry, filled in by get_entries
+        mutable std::unordered_map<std::string, size_t> m_Sizes;
+        mutable std::mutex m_SizesMutex;
     };
 }
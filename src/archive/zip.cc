@@ -4,16 +4,59 @@
 #include "zip.h"
 using namespace AhoViewer;
 
+#include <algorithm>
+#include <cstdint>
 #include <giomm.h>
 #include <iostream>
 #include <zip.h>
 
 Zip::Zip(const std::string& path, const std::string& ex_dir) : Archive::Archive(path, ex_dir) { }
 
+Zip::~Zip()
+{
+    for (zip* zip : m_Handles)
+        zip_discard(zip);
+
+    if (m_MappedFile)
+        g_mapped_file_unref(m_MappedFile);
+}
+
 bool Zip::extract(const std::string& file) const
 {
+    std::vector<unsigned char> buf;
+    const unsigned char* data;
+    size_t size;
+
+    // Stored files are written straight from the mapping
+    if (!map(file, data, size))
+    {
+        if (!read(file, buf))
+            return false;
+
+        data = buf.data();
+        size = buf.size();
+    }
+
+    std::string f_path{ Glib::build_filename(m_ExtractedPath, file) };
+
+    if (!Glib::file_test(Glib::path_get_dirname(f_path), Glib::FILE_TEST_EXISTS))
+        g_mkdir_with_parents(Glib::path_get_dirname(f_path).c_str(), 0755);
+
+    auto f{ Gio::File::create_for_path(f_path) };
+    std::string etag;
+    f->replace_contents(reinterpret_cast<const char*>(data), size, "", etag);
+
+    return true;
+}
+
+bool Zip::read_entry(const std::string& file,
+                     std::vector<unsigned char>& buf,
+                     const Glib::RefPtr<Gio::Cancellable>& c) const
+{
+    // Read in pieces so a cancelled read ahead can stop partway through
+    constexpr zip_uint64_t ChunkSize{ 1024 * 1024 };
     bool found{ false };
-    zip* zip{ zip_open(m_Path.c_str(), ZIP_RDONLY | ZIP_CHECKCONS, nullptr) };
+    zip* zip{ acquire_handle() };
 
     if (zip)
     {
@@ -22,25 +65,24 @@ bool Zip::extract(const std::string& file) const
 
         if (zip_stat(zip, file.c_str(), 0, &st) == 0)
         {
-            std::string f_path{ Glib::build_filename(m_ExtractedPath, st.name) };
-
-            if (!Glib::file_test(Glib::path_get_dirname(f_path), Glib::FILE_TEST_EXISTS))
-                g_mkdir_with_parents(Glib::path_get_dirname(f_path).c_str(), 0755);
-
             zip_file* zfile{ zip_fopen(zip, file.c_str(), 0) };
             if (zfile)
             {
-                std::vector<char> buf(st.size);
-                zip_int64_t buf_size{ zip_fread(zfile, buf.data(), st.size) };
-                if (buf_size != -1)
+                zip_uint64_t n{ 0 };
+                zip_int64_t r{ 0 };
+                buf.resize(st.size);
+
+                while (n < st.size && !(c && c->is_cancelled()) &&
+                       (r = zip_fread(zfile, buf.data() + n, std::min(st.size - n, ChunkSize))) > 0)
+                    n += r;
+
+                if (r != -1 && !(c && c->is_cancelled()))
                 {
-                    auto f{ Gio::File::create_for_path(f_path) };
-                    std::string etag;
-                    f->replace_contents(buf.data(), buf_size, "", etag);
+                    buf.resize(n);
+                    found = true;
                 }
 
                 zip_fclose(zfile);
-                found = true;
             }
             else
             {
@@ -54,14 +96,29 @@ bool Zip::extract(const std::string& file) const
                       << std::endl;
         }
 
-        zip_close(zip);
+        release_handle(zip);
     }
-    else
+
+    return found;
+}
+
+size_t Zip::get_entry_size(const std::string& file) const
+{
+    size_t size{ 0 };
+    zip* zip{ acquire_handle() };
+
+    if (zip)
     {
-        std::cerr << "zip_open: Failed to open '" + m_Path + "'" << std::endl;
+        struct zip_stat st;
+        zip_stat_init(&st);
+
+        if (zip_stat(zip, file.c_str(), 0, &st) == 0 && (st.valid & ZIP_STAT_SIZE))
+            size = st.size;
+
+        release_handle(zip);
     }
 
-    return found;
+    return size;
 }
 
 bool Zip::has_valid_files(const FileType t) const
@@ -72,7 +129,7 @@ bool Zip::has_valid_files(const FileType t) const
 std::vector<std::string> Zip::get_entries(const FileType t) const
 {
     std::vector<std::string> entries;
-    zip* zip{ zip_open(m_Path.c_str(), ZIP_RDONLY | ZIP_CHECKCONS, nullptr) };
+    zip* zip{ acquire_handle() };
 
     if (zip)
     {
@@ -87,9 +144,194 @@ std::vector<std::string> Zip::get_entries(const FileType t) const
                 entries.emplace_back(st.name);
         }
 
-        zip_close(zip);
+        release_handle(zip);
     }
 
     return entries;
 }
+
+bool Zip::map(const std::string& file, const unsigned char*& data, size_t& size) const
+{
+    std::call_once(m_MapOnce, &Zip::map_stored_entries, this);
+
+    auto it{ m_StoredEntries.find(file) };
+    if (it == m_StoredEntries.end())
+        return false;
+
+    data = reinterpret_cast<const unsigned char*>(g_mapped_file_get_contents(m_MappedFile)) +
+           it->second.first;
+    size = it->second.second;
+
+    return true;
+}
+
+// Little endian integers, every read is bounds checked against the mapping
+namespace
+{
+    template<typename T>
+    bool read_le(const unsigned char* data, const size_t len, const size_t offset, T& v)
+    {
+        if (offset > len || len - offset < sizeof(T))
+            return false;
+
+        v = 0;
+        for (size_t i = 0; i < sizeof(T); ++i)
+            v |= static_cast<T>(data[offset + i]) << (i * 8);
+
+        return true;
+    }
+}
+
+void Zip::map_stored_entries() const
+{
+    GError* error{ nullptr };
+    m_MappedFile = g_mapped_file_new(m_Path.c_str(), FALSE, &error);
+
+    if (!m_MappedFile)
+    {
+        std::cerr << "g_mapped_file_new: Failed to map '" + m_Path + "'" << std::endl
+                  << "  " << error->message << std::endl;
+        g_error_free(error);
+        return;
+    }
+
+    const auto* data{ reinterpret_cast<const unsigned char*>(
+        g_mapped_file_get_contents(m_MappedFile)) };
+    const size_t len{ g_mapped_file_get_length(m_MappedFile) };
+
+    // The end of central directory record is 22 bytes followed by an up to 64 KiB comment
+    size_t eocd{ std::string::npos };
+    if (len >= 22)
+    {
+        const size_t start{ len - 22 }, end{ start > 0xFFFF ? start - 0xFFFF : 0 };
+
+        for (size_t i = start + 1; i-- > end;)
+        {
+            uint32_t sig;
+            if (read_le(data, len, i, sig) && sig == 0x06054B50)
+            {
+                eocd = i;
+                break;
+            }
+        }
+    }
+
+    if (eocd == std::string::npos)
+        return;
+
+    uint16_t n16;
+    uint32_t offset32;
+    uint64_t n_entries, cd_offset;
+
+    if (!read_le(data, len, eocd + 10, n16) || !read_le(data, len, eocd + 16, offset32))
+        return;
+
+    n_entries = n16;
+    cd_offset = offset32;
+
+    // Zip64, the real values are in the zip64 end of central directory record which is
+    // pointed to by the locator right before the regular record
+    if ((n16 == 0xFFFF || offset32 == 0xFFFFFFFF) && eocd >= 20)
+    {
+        uint32_t sig;
+        uint64_t zip64_eocd;
+
+        if (!read_le(data, len, eocd - 20, sig) || sig != 0x07064B50 ||
+            !read_le(data, len, eocd - 12, zip64_eocd) ||
+            !read_le(data, len, zip64_eocd, sig) || sig != 0x06064B50 ||
+            !read_le(data, len, zip64_eocd + 32, n_entries) ||
+            !read_le(data, len, zip64_eocd + 48, cd_offset))
+            return;
+    }
+
+    size_t pos{ cd_offset };
+    for (uint64_t i = 0; i < n_entries; ++i)
+    {
+        uint32_t sig, comp_size32, size32, local32;
+        uint16_t flags, method, name_len, extra_len, comment_len;
+
+        if (!read_le(data, len, pos, sig) || sig != 0x02014B50 ||
+            !read_le(data, len, pos + 8, flags) || !read_le(data, len, pos + 10, method) ||
+            !read_le(data, len, pos + 20, comp_size32) || !read_le(data, len, pos + 24, size32) ||
+            !read_le(data, len, pos + 28, name_len) || !read_le(data, len, pos + 30, extra_len) ||
+            !read_le(data, len, pos + 32, comment_len) || !read_le(data, len, pos + 42, local32) ||
+            pos + 46 + name_len > len)
+            return;
+
+        std::string name{ reinterpret_cast<const char*>(data + pos + 46), name_len };
+        uint64_t comp_size{ comp_size32 }, size{ size32 }, local{ local32 };
+
+        // Zip64 extended information, only the fields that overflowed are present
+        for (size_t e = pos + 46 + name_len, e_end = e + extra_len; e + 4 <= e_end;)
+        {
+            uint16_t id, e_len;
+            if (!read_le(data, len, e, id) || !read_le(data, len, e + 2, e_len))
+                break;
+
+            if (id == 0x0001)
+            {
+                size_t f{ e + 4 };
+                if (size32 == 0xFFFFFFFF && read_le(data, len, f, size))
+                    f += 8;
+                if (comp_size32 == 0xFFFFFFFF && read_le(data, len, f, comp_size))
+                    f += 8;
+                if (local32 == 0xFFFFFFFF)
+                    read_le(data, len, f, local);
+                break;
+            }
+
+            e += 4 + e_len;
+        }
+
+        pos += 46 + name_len + extra_len + comment_len;
+
+        // Only unencrypted entries stored without compression can be used as is
+        if (method != ZIP_CM_STORE || (flags & 0x1) || comp_size != size)
+            continue;
+
+        uint16_t l_name_len, l_extra_len;
+        if (!read_le(data, len, local, sig) || sig != 0x04034B50 ||
+            !read_le(data, len, local + 26, l_name_len) ||
+            !read_le(data, len, local + 28, l_extra_len))
+            continue;
+
+        size_t data_offset{ local + 30 + l_name_len + l_extra_len };
+        if (data_offset > len || len - data_offset < size)
+            continue;
+
+        m_StoredEntries.emplace(std::move(name), std::make_pair(data_offset, size));
+    }
+}
+
+zip* Zip::acquire_handle() const
+{
+    std::scoped_lock lock{ m_HandleMutex };
+
+    if (!m_Handles.empty())
+    {
+        zip* zip{ m_Handles.back() };
+        m_Handles.pop_back();
+        return zip;
+    }
+
+    zip* zip{ zip_open(m_Path.c_str(), ZIP_RDONLY | (m_Validated ? 0 : ZIP_CHECKCONS), nullptr) };
+
+    if (zip)
+        m_Validated = true;
+    else
+        std::cerr << "zip_open: Failed to open '" + m_Path + "'" << std::endl;
+
+    return zip;
+}
+
+void Zip::release_handle(zip* zip) const
+{
+    std::scoped_lock lock{ m_HandleMutex };
+
+    // Nothing is ever written so discarding is the same as closing, minus the checks
+    if (m_Handles.size() < MaxHandles)
+        m_Handles.push_back(zip);
+    else
+        zip_discard(zip);
+}
 #endif // HAVE_LIBZIP
@@ -2,19 +2,59 @@
 
 #include "archive.h"
 
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct zip;
+
 namespace AhoViewer
 {
     class Zip : public Archive
     {
     public:
-        Zip(const std::string& path, const std::string& ex_dir);
-        ~Zip() override = default;
+        ~Zip() override;
 
         bool extract(const std::string& file) const override;
         bool has_valid_files(const FileType t) const override;
         std::vector<std::string> get_entries(const FileType t) const override;
+        bool map(const std::string& file, const unsigned char*& data, size_t& size) const override;
 
         static constexpr int MagicSize{ 4 };
         static constexpr char Magic[MagicSize]{ 'P', 'K', 0x03, 0x04 };
+
+    protected:
+        Zip(const std::string& path, const std::string& ex_dir);
+
+        bool read_entry(const std::string& file,
+                        std::vector<unsigned char>& buf,
+                        const Glib::RefPtr<Gio::Cancellable>& c = {}) const override;
+        size_t get_entry_size(const std::string& file) const override;
+        // Entries are independent, each reader uses its own handle from the pool
+        size_t get_max_readers() const override { return MaxHandles; }
+
+    private:
+        // A zip handle can only be used by one thread at a time, the cache, thumbnail and
+        // read ahead threads each take one from the pool and give it back when done
+        ::zip* acquire_handle() const;
+        void release_handle(::zip* zip) const;
+
+        // Maps the archive and finds the data of every stored entry by reading the
+        // central directory and local headers
+        void map_stored_entries() const;
+
+        // Idle handles kept open, more than this are closed when released
+        static constexpr size_t MaxHandles{ 4 };
+
+        mutable GMappedFile* m_MappedFile{ nullptr };
+        // Offset and size of each stored entry's data in m_MappedFile
+        mutable std::unordered_map<std::string, std::pair<size_t, size_t>> m_StoredEntries;
+        mutable std::once_flag m_MapOnce;
+
+        mutable std::vector<::zip*> m_Handles;
+        // The central directory is only consistency checked the first time it's opened
+        mutable bool m_Validated{ false };
+        mutable std::mutex m_HandleMutex;
     };
 }
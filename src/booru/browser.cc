@@ -352,7 +352,7 @@ void Browser::on_save_progress(const Page* p)
 void Browser::on_image_progress(const Image* bimage, double c, double t)
 {
     double speed{ (c / std::chrono::duration<double>(std::chrono::steady_clock::now() -
-                                                     bimage->m_Curler.get_start_time())
+                                                     bimage->m_Curler->get_start_time())
                            .count()) };
 
     Glib::ustring msg{
@@ -414,7 +414,7 @@ void Browser::connect_image_signals(const std::shared_ptr<Image> bimage)
         bimage->signal_progress().connect(sigc::mem_fun(*this, &Browser::on_image_progress));
 
     // Update progress immediatly when switching to a downloading image
-    if (bimage->m_Curler.is_active())
+    if (bimage->m_Curler->is_active())
         bimage->on_progress();
 }
 
@@ -3,6 +3,12 @@ using namespace AhoViewer::Booru;
 
 #include "imagefetcher.h"
 
+#include <algorithm>
+#include <cstring>
+#include <glib/gstdio.h>
+#include <iostream>
+#include <mutex>
+
 // Used for looking closer at what libcurl is doing
 // set it to 1 with CXXFLAGS and prepare to be spammed
 #ifndef VERBOSE_LIBCURL
@@ -11,6 +17,77 @@ using namespace AhoViewer::Booru;
 
 const char* Curler::UserAgent{ "Mozilla/5.0" };
 
+namespace
+{
+    // Buffers of finished downloads are kept here to be reused by the next ones
+    class BufferPool
+    {
+    public:
+        // Returns a buffer with at least capacity bytes reserved
+        std::vector<unsigned char> acquire(const size_t capacity)
+        {
+            {
+                std::scoped_lock lock{ m_Mutex };
+
+                // The smallest buffer that fits, as long as it isn't wastefully large
+                auto best{ m_Buffers.end() };
+                for (auto it{ m_Buffers.begin() }; it != m_Buffers.end(); ++it)
+                    if (it->capacity() >= capacity && it->capacity() <= capacity * 4 &&
+                        (best == m_Buffers.end() || it->capacity() < best->capacity()))
+                        best = it;
+
+                if (best != m_Buffers.end())
+                {
+                    std::vector<unsigned char> buf{ std::move(*best) };
+                    m_Buffers.erase(best);
+                    m_Bytes -= buf.capacity();
+
+                    return buf;
+                }
+            }
+
+            std::vector<unsigned char> buf;
+            reserve(buf, capacity);
+
+            return buf;
+        }
+
+        // Grows buf, every allocation goes through here or acquire so they're all counted
+        void reserve(std::vector<unsigned char>& buf, const size_t capacity)
+        {
+            buf.reserve(capacity);
+            m_Allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        size_t get_allocations() const { return m_Allocations; }
+
+        void release(std::vector<unsigned char>&& buf)
+        {
+            if (buf.capacity() == 0)
+                return;
+
+            buf.clear();
+
+            std::scoped_lock lock{ m_Mutex };
+            if (m_Bytes + buf.capacity() <= MaxBytes)
+            {
+                m_Bytes += buf.capacity();
+                m_Buffers.push_back(std::move(buf));
+            }
+        }
+
+    private:
+        static constexpr size_t MaxBytes{ 64 * 1024 * 1024 };
+
+        std::vector<std::vector<unsigned char>> m_Buffers;
+        size_t m_Bytes{ 0 };
+        std::atomic<size_t> m_Allocations{ 0 };
+        std::mutex m_Mutex;
+    };
+
+    BufferPool Pool;
+}
+
 size_t Curler::write_cb(const unsigned char* ptr, size_t size, size_t nmemb, void* userp)
 {
     Curler* self{ static_cast<Curler*>(userp) };
@@ -30,10 +107,29 @@ size_t Curler::write_cb(const unsigned char* ptr, size_t size, size_t nmemb, voi
 
     size_t len{ size * nmemb };
 
-    self->m_Buffer.insert(self->m_Buffer.end(), ptr, ptr + len);
-    self->m_SignalWrite(ptr, len);
+    if (self->m_Size < self->m_Head.size())
+        std::copy_n(ptr,
+                    std::min(len, self->m_Head.size() - self->m_Size),
+                    self->m_Head.begin() + self->m_Size);
+
+    // Returning less than len aborts the transfer
+    if (!self->m_OutputPath.empty())
+    {
+        if (!self->write_output(ptr, len))
+            return 0;
+    }
+    else
+    {
+        self->append(ptr, len);
+    }
+
+    {
+        std::scoped_lock lock{ self->m_WriteMutex };
+        if (!self->is_cancelled())
+            self->m_SignalWrite(ptr, len);
+    }
 
-    self->m_DownloadCurrent = self->m_Buffer.size();
+    self->m_DownloadCurrent = self->m_Size;
 
     if (!self->is_cancelled())
         self->m_SignalProgress();
@@ -47,6 +143,35 @@ int Curler::progress_cb(void* userp, curl_off_t, curl_off_t, curl_off_t, curl_of
     return self->is_cancelled();
 }
 
+size_t Curler::header_cb(const char* ptr, size_t size, size_t nmemb, void* userp)
+{
+    Curler* self{ static_cast<Curler*>(userp) };
+    const size_t len{ size * nmemb };
+    std::string line{ ptr, len };
+
+    // Every response starts with its status line, including the ones being redirected from
+    if (line.compare(0, 5, "HTTP/") == 0)
+    {
+        self->m_ResponseHeaders.clear();
+        return len;
+    }
+
+    const size_t colon{ line.find(':') };
+    if (colon == std::string::npos)
+        return len;
+
+    const size_t start{ line.find_first_not_of(" \t", colon + 1) };
+    const size_t end{ line.find_last_not_of(" \t\r\n") };
+    std::string value;
+
+    if (start != std::string::npos && end != std::string::npos && end >= start)
+        value = line.substr(start, end - start + 1);
+
+    self->m_ResponseHeaders[Glib::ustring{ line.substr(0, colon) }.lowercase()] = value;
+
+    return len;
+}
+
 Curler::Curler(const std::string& url, CURLSH* share)
     : m_EasyHandle(curl_easy_init()),
       m_Cancel(Gio::Cancellable::create())
@@ -56,6 +181,8 @@ Curler::Curler(const std::string& url, CURLSH* share)
     curl_easy_setopt(m_EasyHandle, CURLOPT_WRITEDATA, this);
     curl_easy_setopt(m_EasyHandle, CURLOPT_XFERINFOFUNCTION, &Curler::progress_cb);
     curl_easy_setopt(m_EasyHandle, CURLOPT_XFERINFODATA, this);
+    curl_easy_setopt(m_EasyHandle, CURLOPT_HEADERFUNCTION, &Curler::header_cb);
+    curl_easy_setopt(m_EasyHandle, CURLOPT_HEADERDATA, this);
     curl_easy_setopt(m_EasyHandle, CURLOPT_NOPROGRESS, 0);
     curl_easy_setopt(m_EasyHandle, CURLOPT_FOLLOWLOCATION, 1);
     curl_easy_setopt(m_EasyHandle, CURLOPT_MAXREDIRS, 5);
@@ -83,7 +210,131 @@ Curler::Curler(const std::string& url, CURLSH* share)
 
 Curler::~Curler()
 {
+    close_output(false);
     curl_easy_cleanup(m_EasyHandle);
+    curl_slist_free_all(m_RequestHeaders);
+}
+
+size_t Curler::get_buffer_allocations()
+{
+    return Pool.get_allocations();
+}
+
+void Curler::clear()
+{
+    Pool.release(std::move(m_Buffer));
+    for (auto& chunk : m_Chunks)
+        Pool.release(std::move(chunk));
+
+    m_Buffer.clear();
+    m_Chunks.clear();
+    m_Size = 0;
+
+    close_output(false);
+}
+
+bool Curler::peek(unsigned char* dst, const size_t n) const
+{
+    if (m_Size < n || n > m_Head.size())
+        return false;
+
+    std::memcpy(dst, m_Head.data(), n);
+
+    return true;
+}
+
+void Curler::append(const unsigned char* ptr, size_t len)
+{
+    // Content-Length is -1 when the server didn't send one
+    if (m_Size == 0)
+        m_Chunked = m_DownloadTotal <= 0;
+
+    m_Size += len;
+
+    if (!m_Chunked)
+    {
+        if (m_Buffer.capacity() == 0)
+        {
+            m_Buffer = Pool.acquire(std::max(static_cast<size_t>(m_DownloadTotal), len));
+        }
+        else if (m_Buffer.size() + len > m_Buffer.capacity())
+        {
+            // The server sent more than it said it would
+            Pool.reserve(m_Buffer, std::max(m_Buffer.capacity() * 2, m_Buffer.size() + len));
+        }
+
+        m_Buffer.insert(m_Buffer.end(), ptr, ptr + len);
+        return;
+    }
+
+    while (len > 0)
+    {
+        if (m_Chunks.empty() || m_Chunks.back().size() == ChunkSize)
+            m_Chunks.push_back(Pool.acquire(ChunkSize));
+
+        auto& chunk{ m_Chunks.back() };
+        const size_t n{ std::min(len, ChunkSize - chunk.size()) };
+
+        chunk.insert(chunk.end(), ptr, ptr + n);
+        ptr += n;
+        len -= n;
+    }
+}
+
+void Curler::join_chunks() const
+{
+    if (m_Chunks.empty())
+        return;
+
+    Pool.release(std::move(m_Buffer));
+    m_Buffer = Pool.acquire(m_Size);
+
+    for (auto& chunk : m_Chunks)
+    {
+        m_Buffer.insert(m_Buffer.end(), chunk.begin(), chunk.end());
+        Pool.release(std::move(chunk));
+    }
+
+    m_Chunks.clear();
+}
+
+bool Curler::write_output(const unsigned char* ptr, const size_t len)
+{
+    if (!m_Output)
+    {
+        const std::string part{ m_OutputPath + ".part" };
+        m_Output = g_fopen(part.c_str(), "wb");
+
+        if (!m_Output)
+        {
+            std::cerr << "Failed to open '" << part << "' for writing" << std::endl;
+            return false;
+        }
+    }
+
+    if (std::fwrite(ptr, 1, len, m_Output) != len)
+    {
+        std::cerr << "Failed to write to '" << m_OutputPath << ".part'" << std::endl;
+        return false;
+    }
+
+    m_Size += len;
+
+    return true;
+}
+
+// Called by the ImageFetcher once the transfer is done, before signal_finished is emitted
+void Curler::close_output(const bool keep)
+{
+    if (!m_Output)
+        return;
+
+    std::fclose(m_Output);
+    m_Output = nullptr;
+
+    const std::string part{ m_OutputPath + ".part" };
+    if (!keep || g_rename(part.c_str(), m_OutputPath.c_str()) != 0)
+        g_unlink(part.c_str());
 }
 
 void Curler::set_url(std::string url)
@@ -102,13 +353,11 @@ void Curler::set_referer(const std::string& url) const
     curl_easy_setopt(m_EasyHandle, CURLOPT_REFERER, url.c_str());
 }
 
+// An empty username removes the credentials of a previous account
 void Curler::set_http_auth(const std::string& u, const std::string& p) const
 {
-    if (!u.empty())
-    {
-        curl_easy_setopt(m_EasyHandle, CURLOPT_USERNAME, u.c_str());
-        curl_easy_setopt(m_EasyHandle, CURLOPT_PASSWORD, p.c_str());
-    }
+    curl_easy_setopt(m_EasyHandle, CURLOPT_USERNAME, u.empty() ? nullptr : u.c_str());
+    curl_easy_setopt(m_EasyHandle, CURLOPT_PASSWORD, u.empty() ? nullptr : p.c_str());
 }
 
 void Curler::set_cookie_jar(const std::string& path) const
@@ -132,6 +381,18 @@ void Curler::set_share_handle(CURLSH* s) const
     curl_easy_setopt(m_EasyHandle, CURLOPT_SHARE, s);
 }
 
+void Curler::set_headers(const std::vector<std::string>& headers)
+{
+    curl_slist* list{ nullptr };
+    for (const std::string& h : headers)
+        list = curl_slist_append(list, h.c_str());
+
+    // libcurl doesn't copy the list, the old one can only be freed once it's replaced
+    curl_easy_setopt(m_EasyHandle, CURLOPT_HTTPHEADER, list);
+    curl_slist_free_all(m_RequestHeaders);
+    m_RequestHeaders = list;
+}
+
 std::string Curler::escape(const std::string& str) const
 {
     std::string r;
@@ -150,6 +411,8 @@ bool Curler::perform()
 {
     m_Cancel->reset();
     clear();
+    m_ResponseHeaders.clear();
+    m_DownloadCurrent = m_DownloadTotal = 0;
 
     return curl_easy_perform(m_EasyHandle) == CURLE_OK;
 }
@@ -168,6 +431,12 @@ long Curler::get_response_code() const
     return c;
 }
 
+std::string Curler::get_header(const std::string& name) const
+{
+    auto it{ m_ResponseHeaders.find(Glib::ustring{ name }.lowercase()) };
+    return it != m_ResponseHeaders.end() ? it->second : "";
+}
+
 void Curler::pause()
 {
     m_Pause = true;
@@ -188,6 +457,8 @@ void Curler::unpause()
 
 void Curler::save_file(const std::string& path) const
 {
+    join_chunks();
+
     std::string etag;
     Glib::RefPtr<Gio::File> f{ Gio::File::create_for_path(path) };
     f->replace_contents(reinterpret_cast<const char*>(m_Buffer.data()), m_Buffer.size(), "", etag);
@@ -195,6 +466,8 @@ void Curler::save_file(const std::string& path) const
 
 void Curler::save_file_async(const std::string& path, const Gio::SlotAsyncReady& cb)
 {
+    join_chunks();
+
     Glib::RefPtr<Gio::File> f{ Gio::File::create_for_path(path) };
     f->replace_contents_async(
         cb, m_Cancel, reinterpret_cast<const char*>(m_Buffer.data()), m_Buffer.size(), "");
@@ -1,10 +1,17 @@
 #pragma once
 
+#include "uidispatcher.h"
+
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <cstdio>
 #include <curl/curl.h>
 #include <giomm.h>
 #include <glibmm.h>
+#include <map>
+#include <mutex>
+#include <vector>
 
 namespace AhoViewer::Booru
 {
@@ -29,16 +36,22 @@ namespace AhoViewer::Booru
         void set_cookie_file(const std::string& path) const;
         void set_post_fields(const std::string& fields) const;
         void set_share_handle(CURLSH* s) const;
+        // Extra request headers ("Name: value"), an empty list removes them
+        void set_headers(const std::vector<std::string>& headers);
 
         std::string escape(const std::string& str) const;
         bool perform();
 
         void set_imagefetcher(ImageFetcher* f) { m_ImageFetcher = f; }
-        void clear()
-        {
-            m_Buffer.clear();
-            std::vector<unsigned char>().swap(m_Buffer);
-        }
+        // Streams downloads to path instead of keeping them in memory. They are written to
+        // path.part which is renamed to path once the transfer has finished successfully
+        void set_output_path(std::string path) { m_OutputPath = std::move(path); }
+        // Hands the downloaded data back to the buffer pool, and removes an unfinished
+        // output file
+        void clear();
+        // Number of download buffers allocated so far by every curler, the ones reused
+        // from the pool don't count
+        static size_t get_buffer_allocations();
         void save_file(const std::string& path) const;
         void save_file_async(const std::string& path, const Gio::SlotAsyncReady& cb);
         void save_file_finish(const Glib::RefPtr<Gio::AsyncResult>& r);
@@ -48,13 +61,23 @@ namespace AhoViewer::Booru
         bool is_active() const { return m_Active; }
         std::string get_url() const { return m_Url; }
 
-        unsigned char* get_data() { return m_Buffer.data(); }
-        size_t get_data_size() const { return m_Buffer.size(); }
+        // Joins the chunks of a download with an unknown length the first time it's called,
+        // only call it once the download has finished. Empty when streaming to a file
+        unsigned char* get_data()
+        {
+            join_chunks();
+            return m_Buffer.data();
+        }
+        size_t get_data_size() const { return m_Size; }
+        // Copies the first n (at most 16) bytes, safe to use while downloading
+        bool peek(unsigned char* dst, const size_t n) const;
 
         std::string get_error() const { return curl_easy_strerror(m_Response); }
         CURLcode get_response() const { return m_Response; }
         // HTTP reponse code
         long get_response_code() const;
+        // Value of a header from the last response, name is case insensitive
+        std::string get_header(const std::string& name) const;
         time_point_t get_start_time() const { return m_StartTime; }
 
         void pause();
@@ -64,24 +87,51 @@ namespace AhoViewer::Booru
         void unpause();
 
         void cancel() { m_Cancel->cancel(); }
+        // perform does this itself, only needed when cancellation is checked without it
+        void reset_cancel() { m_Cancel->reset(); }
         bool is_cancelled() const { return m_Cancel->is_cancelled(); }
 
         SignalWriteType signal_write() const { return m_SignalWrite; }
-        Glib::Dispatcher& signal_progress() { return m_SignalProgress; }
+        UIDispatcher& signal_progress() { return m_SignalProgress; }
         Glib::Dispatcher& signal_finished() { return m_SignalFinished; }
 
     private:
         static size_t write_cb(const unsigned char* ptr, size_t size, size_t nmemb, void* userp);
         static int progress_cb(void* userp, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
+        static size_t header_cb(const char* ptr, size_t size, size_t nmemb, void* userp);
+
+        void append(const unsigned char* ptr, size_t len);
+        void join_chunks() const;
+        bool write_output(const unsigned char* ptr, size_t len);
+        void close_output(const bool keep);
 
         static const char* UserAgent;
+        static constexpr size_t ChunkSize{ 256 * 1024 };
 
         CURL* m_EasyHandle;
         CURLcode m_Response;
         std::string m_Url;
-        std::vector<unsigned char> m_Buffer;
+
+        // Downloads with a Content-Length go straight into m_Buffer which is reserved up
+        // front, anything else is written to fixed size chunks
+        mutable std::vector<unsigned char> m_Buffer;
+        mutable std::vector<std::vector<unsigned char>> m_Chunks;
+        size_t m_Size{ 0 };
+        bool m_Chunked{ false };
+        // The start of the data is always kept for peek
+        std::array<unsigned char, 16> m_Head;
+
+        curl_slist* m_RequestHeaders{ nullptr };
+        // Keyed by the lowercased header name, only holds the final response's headers
+        // when redirects are followed
+        std::map<std::string, std::string> m_ResponseHeaders;
+
+        std::string m_OutputPath;
+        FILE* m_Output{ nullptr };
 
         std::atomic<bool> m_Active{ false }, m_Pause{ false };
+        // Held while signal_write is emitted, see ImageFetcher::remove_handles
+        std::mutex m_WriteMutex;
         std::atomic<curl_off_t> m_DownloadTotal{ 0 }, m_DownloadCurrent{ 0 };
         time_point_t m_StartTime;
 
@@ -89,6 +139,7 @@ namespace AhoViewer::Booru
         Glib::RefPtr<Gio::Cancellable> m_Cancel;
 
         SignalWriteType m_SignalWrite;
-        Glib::Dispatcher m_SignalProgress, m_SignalFinished;
+        UIDispatcher m_SignalProgress;
+        Glib::Dispatcher m_SignalFinished;
     };
 }
@@ -12,6 +12,8 @@ using namespace AhoViewer::Booru;
 
 Image::Image(std::string path,
              std::string url,
+             std::string sample_path,
+             std::string sample_url,
              std::string thumb_path,
              std::string thumb_url,
              std::string post_url,
@@ -22,6 +24,8 @@ Image::Image(std::string path,
              ImageFetcher& fetcher)
     : AhoViewer::Image{ path },
       m_Url{ std::move(url) },
+      m_SampleUrl{ std::move(sample_url) },
+      m_SamplePath{ std::move(sample_path) },
       m_ThumbnailUrl{ std::move(thumb_url) },
       m_PostUrl{ std::move(post_url) },
       m_Tags{ std::move(tags) },
@@ -29,40 +33,53 @@ Image::Image(std::string path,
       m_Site{ std::move(site) },
       m_ImageFetcher{ fetcher },
       m_LastDraw{ std::chrono::steady_clock::now() },
-      m_Curler{ m_Url, m_Site->get_share_handle() },
-      m_ThumbnailCurler{ m_ThumbnailUrl, m_Site->get_share_handle() },
-      m_NotesCurler{ notes_url, m_Site->get_share_handle() }
+      m_Curler{ std::make_shared<Curler>(m_Url, m_Site->get_share_handle()) },
+      m_ThumbnailCurler{ std::make_shared<Curler>(m_ThumbnailUrl, m_Site->get_share_handle()) },
+      m_NotesCurler{ std::make_shared<Curler>(notes_url, m_Site->get_share_handle()) }
 {
     m_ThumbnailPath = std::move(thumb_path);
 
+    // The sample of an animation is a still image
+    if (m_IsWebM || Glib::str_has_suffix(Glib::ustring{ m_Path }.lowercase(), ".gif"))
+        m_SampleUrl.clear();
+
+    // Written to disk as it arrives, the loader is fed the same data in on_write
+    m_Curler->set_output_path(m_Path);
+
     if (!m_IsWebM)
-        m_Curler.signal_write().connect(sigc::mem_fun(*this, &Image::on_write));
+        m_Curler->signal_write().connect(sigc::mem_fun(*this, &Image::on_write));
 
-    m_ThumbnailCurler.signal_finished().connect([&]() { m_ThumbnailCond.notify_one(); });
-    m_ThumbnailCurler.set_referer(m_Site->get_url());
-    m_Curler.set_referer(m_PostUrl);
-    m_Curler.signal_progress().connect(sigc::mem_fun(*this, &Image::on_progress));
-    m_Curler.signal_finished().connect(sigc::mem_fun(*this, &Image::on_finished));
+    // The curlers can outlive this, handlers are only connected to member functions so
+    // they are disconnected when it's destroyed
+    m_ThumbnailCurler->signal_finished().connect(
+        sigc::mem_fun(*this, &Image::on_thumbnail_downloaded));
+    m_ThumbnailCurler->set_referer(m_Site->get_url());
+    m_Curler->set_referer(m_PostUrl);
+    m_Curler->signal_progress().connect(sigc::mem_fun(*this, &Image::on_progress));
+    m_Curler->signal_finished().connect(sigc::mem_fun(*this, &Image::on_finished));
 
     if (!notes_url.empty())
-    {
-        m_NotesCurler.signal_finished().connect(sigc::mem_fun(*this, &Image::on_notes_downloaded));
-        m_ImageFetcher.add_handle(&m_NotesCurler);
-    }
+        m_NotesCurler->signal_finished().connect(sigc::mem_fun(*this, &Image::on_notes_downloaded));
 }
 
 Image::~Image()
 {
     cancel_download();
     cancel_thumbnail_download();
+
+    // The fetcher is shared with other tabs and keeps running, transfers it is still
+    // working on are handed over to it and destroyed once it has let go of them
+    std::vector<std::shared_ptr<Curler>> active;
+    cancel_transfers(active);
+    m_ImageFetcher.remove_handles(std::move(active));
 }
 
 // True if the data is being downloaded by the curler
 // or if the pixbuf is being loaded from the saved local file
 bool Image::is_loading() const
 {
-    return (m_IsWebM && !Glib::file_test(m_Path, Glib::FILE_TEST_EXISTS)) || m_Curler.is_active() ||
-           AhoViewer::Image::is_loading();
+    return (m_IsWebM && !Glib::file_test(m_Path, Glib::FILE_TEST_EXISTS)) ||
+           m_Curler->is_active() || AhoViewer::Image::is_loading();
 }
 
 std::string Image::get_filename() const
@@ -70,21 +87,45 @@ std::string Image::get_filename() const
     return m_Site->get_name() + "/" + Glib::path_get_basename(m_Path);
 }
 
-const Glib::RefPtr<Gdk::Pixbuf>& Image::get_thumbnail(Glib::RefPtr<Gio::Cancellable> c)
+// Thumbnails are downloaded by Booru::ImageList with download_thumbnail,
+// all that's left to do here is decode the finished download
+const Glib::RefPtr<Gdk::Pixbuf>& Image::get_thumbnail(Glib::RefPtr<Gio::Cancellable>)
 {
-    if (!m_ThumbnailPixbuf && !c->is_cancelled())
-    {
-        m_ImageFetcher.add_handle(&m_ThumbnailCurler);
+    return decode_thumbnail();
+}
 
+bool Image::download_thumbnail(std::function<void()> cb)
+{
+    if (m_ThumbnailPixbuf || m_ThumbnailPrefetched)
+        return false;
+
+    m_ThumbnailDownloaded = std::move(cb);
+
+    // Restarting the prefetch would throw away what it has downloaded so far
+    if (m_ThumbnailPrefetching)
+        m_ImageFetcher.set_priority(m_ThumbnailCurler.get(), ImageFetcher::Priority::THUMBNAIL);
+    else
+        m_ImageFetcher.add_handle(m_ThumbnailCurler.get(), ImageFetcher::Priority::THUMBNAIL);
+
+    return true;
+}
+
+void Image::prefetch_thumbnail()
+{
+    if (m_ThumbnailPixbuf || m_ThumbnailPrefetching || m_ThumbnailPrefetched)
+        return;
+
+    m_ThumbnailPrefetching = true;
+    m_ImageFetcher.add_handle(m_ThumbnailCurler.get(), ImageFetcher::Priority::SPECULATIVE);
+}
+
+const Glib::RefPtr<Gdk::Pixbuf>& Image::decode_thumbnail()
+{
+    if (!m_ThumbnailPixbuf)
+    {
+        if (!m_ThumbnailCurler->is_cancelled() && m_ThumbnailCurler->get_response() == CURLE_OK)
         {
-            std::unique_lock<std::mutex> lock{ m_ThumbnailMutex };
-            m_ThumbnailCond.wait(lock, [&]() {
-                return m_ThumbnailCurler.is_cancelled() || !m_ThumbnailCurler.is_active();
-            });
-        }
-        if (!m_ThumbnailCurler.is_cancelled() && m_ThumbnailCurler.get_response() == CURLE_OK)
-        {
-            m_ThumbnailCurler.save_file(m_ThumbnailPath);
+            m_ThumbnailCurler->save_file(m_ThumbnailPath);
 
             m_ThumbnailLock.lock();
             // This doesn't need to be cancellable since booru
@@ -95,13 +136,13 @@ const Glib::RefPtr<Gdk::Pixbuf>& Image::get_thumbnail(Glib::RefPtr<Gio::Cancella
                                                       Gio::Cancellable::create());
             m_ThumbnailLock.unlock();
         }
-        else if (!m_ThumbnailCurler.is_cancelled())
+        else if (!m_ThumbnailCurler->is_cancelled())
         {
             std::cerr << "Error while downloading thumbnail " << m_ThumbnailUrl << std::endl
-                      << "  " << m_ThumbnailCurler.get_error() << std::endl;
+                      << "  " << m_ThumbnailCurler->get_error() << std::endl;
         }
 
-        m_ThumbnailCurler.clear();
+        m_ThumbnailCurler->clear();
     }
 
     return m_ThumbnailPixbuf;
@@ -111,11 +152,23 @@ void Image::load_pixbuf(Glib::RefPtr<Gio::Cancellable> c)
 {
     if (!m_Pixbuf && !m_PixbufError)
     {
+        bool want_original;
+        {
+            std::scoped_lock lock{ m_SampleMutex };
+            want_original = m_WantOriginal;
+        }
+
         // Load the local file
         if (Glib::file_test(m_Path, Glib::FILE_TEST_EXISTS))
         {
             AhoViewer::Image::load_pixbuf(c);
         }
+        else if (!want_original && !m_SampleUrl.empty() &&
+                 Glib::file_test(m_SamplePath, Glib::FILE_TEST_EXISTS))
+        {
+            load_pixbuf_from_file(m_SamplePath, c);
+            m_ShowingSample = !!m_Pixbuf;
+        }
         // This will either start the download and do nothing, or if the
         // download is already started and the pixbuf loader has created a
         // pixbuf set m_Pixbuf to that loader pixbuf
@@ -128,25 +181,33 @@ void Image::load_pixbuf(Glib::RefPtr<Gio::Cancellable> c)
 
 void Image::reset_pixbuf()
 {
-    if (m_Curler.is_active())
+    if (m_Curler->is_active())
         cancel_download();
 
+    m_ShowingSample = false;
     AhoViewer::Image::reset_pixbuf();
 }
 
+void Image::load_full_size()
+{
+    if (!m_SampleUrl.empty())
+        download_original();
+}
+
 void Image::save(const std::string& path)
 {
     if (!Glib::file_test(m_Path, Glib::FILE_TEST_EXISTS))
     {
-        start_download();
+        // Never save a sample
+        download_original();
 
         std::unique_lock<std::mutex> lock{ m_DownloadMutex };
         m_DownloadCond.wait(lock, [&]() {
-            return m_Curler.is_cancelled() || Glib::file_test(m_Path, Glib::FILE_TEST_EXISTS);
+            return m_Curler->is_cancelled() || Glib::file_test(m_Path, Glib::FILE_TEST_EXISTS);
         });
     }
 
-    if (m_Curler.is_cancelled())
+    if (m_Curler->is_cancelled())
         return;
 
     Glib::RefPtr<Gio::File> src = Gio::File::create_for_path(m_Path),
@@ -165,23 +226,90 @@ void Image::save(const std::string& path)
 
 void Image::cancel_download()
 {
-    m_Curler.cancel();
+    m_ImageFetcher.cancel_handle(m_Curler.get());
     close_loader();
 
+    {
+        std::scoped_lock lock{ m_SampleMutex };
+        m_DownloadingSample = false;
+    }
+
     m_DownloadCond.notify_one();
 }
 
 void Image::cancel_thumbnail_download()
 {
-    m_ThumbnailCurler.cancel();
-    m_ThumbnailCond.notify_one();
+    m_ImageFetcher.cancel_handle(m_ThumbnailCurler.get());
+    m_ThumbnailDownloaded  = nullptr;
+    m_ThumbnailPrefetching = m_ThumbnailPrefetched = false;
+}
+
+void Image::cancel_transfers(std::vector<std::shared_ptr<Curler>>& active)
+{
+    for (const auto& c : { m_Curler, m_ThumbnailCurler, m_NotesCurler })
+    {
+        c->cancel();
+        if (c->is_active())
+            active.push_back(c);
+    }
+}
+
+void Image::set_foreground(const bool foreground)
+{
+    m_Foreground = foreground;
+
+    if (m_Curler->is_active())
+        m_ImageFetcher.set_priority(m_Curler.get(),
+                                    foreground ? ImageFetcher::Priority::IMAGE
+                                               : ImageFetcher::Priority::PREFETCH);
+}
+
+void Image::load_notes()
+{
+    // The fetcher doesn't report cancelled transfers, so one that was cancelled before it
+    // finished is requested again
+    if ((m_NotesRequested && !m_NotesCurler->is_cancelled()) || m_NotesCurler->is_active() ||
+        m_NotesCurler->get_url().empty())
+        return;
+
+    m_NotesRequested = true;
+
+    if (m_Site->get_cached_notes(m_NotesCurler->get_url(), m_Notes))
+    {
+        if (m_Notes.size() > 0)
+            m_SignalNotesChanged();
+    }
+    else
+    {
+        m_ImageFetcher.add_handle(m_NotesCurler.get(), ImageFetcher::Priority::NOTES);
+    }
+}
+
+void Image::download_original()
+{
+    {
+        std::scoped_lock lock{ m_SampleMutex };
+        m_WantOriginal = true;
+    }
+
+    if (!Glib::file_test(m_Path, Glib::FILE_TEST_EXISTS))
+        start_download();
 }
 
 // Returns true if the download was started
 bool Image::start_download()
 {
-    if (!m_Curler.is_active())
+    std::scoped_lock lock{ m_SampleMutex };
+
+    // The sample's download is still finishing up when m_DownloadingSample is set
+    if (!m_Curler->is_active() && !m_DownloadingSample)
     {
+        // Samples are only used when the original would take too long to download
+        m_DownloadingSample = !m_WantOriginal && !m_SampleUrl.empty() && m_Site->use_samples() &&
+                              m_ImageFetcher.prefer_samples(m_Url);
+        m_Curler->set_url(m_DownloadingSample ? m_SampleUrl : m_Url);
+        m_Curler->set_output_path(m_DownloadingSample ? m_SamplePath : m_Path);
+
         if (!m_IsWebM)
         {
             m_Loader = Gdk::PixbufLoader::create();
@@ -190,7 +318,9 @@ bool Image::start_download()
             m_Loader->signal_area_updated().connect(sigc::mem_fun(*this, &Image::on_area_updated));
         }
 
-        m_ImageFetcher.add_handle(&m_Curler);
+        m_ImageFetcher.add_handle(m_Curler.get(),
+                                  m_Foreground ? ImageFetcher::Priority::IMAGE
+                                               : ImageFetcher::Priority::PREFETCH);
 
         return true;
     }
@@ -216,13 +346,14 @@ void Image::close_loader()
 
 void Image::on_write(const unsigned char* d, size_t l)
 {
-    if (m_Curler.is_cancelled())
+    if (m_Curler->is_cancelled())
         return;
 
-    if (!m_GIFanim && !m_IsGifChecked && m_Curler.get_data_size() >= 4)
+    unsigned char magic[4];
+    if (!m_GIFanim && !m_IsGifChecked && m_Curler->peek(magic, sizeof(magic)))
     {
         m_IsGifChecked = true;
-        if (is_gif(m_Curler.get_data()))
+        if (is_gif(magic))
         {
             m_GIFanim = new gif_animation;
             gif_create(m_GIFanim, &m_BitmapCallbacks);
@@ -251,46 +382,91 @@ void Image::on_write(const unsigned char* d, size_t l)
 void Image::on_progress()
 {
     curl_off_t c, t;
-    m_Curler.get_progress(c, t);
+    m_Curler->get_progress(c, t);
     m_SignalProgress(this, c, t);
 }
 
-// This is called from the ImageFetcher when the doawnload finished and was not cancelled
+// This is called from the ImageFetcher when the doawnload finished and was not cancelled,
+// the Curler has already moved the finished file into place
 void Image::on_finished()
 {
-    if (m_Curler.get_data_size() > 0)
+    bool sample;
+    {
+        std::scoped_lock lock{ m_SampleMutex };
+        sample = m_DownloadingSample;
+    }
+    const std::string& path{ sample ? m_SamplePath : m_Path };
+
+    if (m_Curler->get_data_size() > 0 && Glib::file_test(path, Glib::FILE_TEST_EXISTS))
     {
+        // The animation decoder needs all of the data at once
         if (m_GIFanim)
         {
-            m_GIFdataSize = m_Curler.get_data_size();
-            m_GIFdata     = new unsigned char[m_GIFdataSize];
-            memcpy(m_GIFdata, m_Curler.get_data(), m_GIFdataSize);
+            char* buffer;
+            gsize size;
 
-            AhoViewer::Image::load_gif();
-        }
-        m_Curler.save_file_async(m_Path, [&](Glib::RefPtr<Gio::AsyncResult>& r) {
-            try
+            if (Gio::File::create_for_path(path)->load_contents(buffer, size))
             {
-                m_Curler.save_file_finish(r);
-                m_Loading = false;
-                m_SignalPixbufChanged();
-                m_DownloadCond.notify_one();
+                m_GIFdataSize = size;
+                m_GIFdata     = new unsigned char[m_GIFdataSize];
+                memcpy(m_GIFdata, buffer, m_GIFdataSize);
+                g_free(buffer);
+
+                AhoViewer::Image::load_gif();
             }
-            catch (const Gio::Error& e)
+        }
+        // The original was loaded in the background, it can replace the sample now
+        else if (!sample && m_ShowingSample)
+        {
+            std::scoped_lock lock{ m_DownloadMutex };
+            if (m_Loader)
             {
-                if (e.code() != Gio::Error::CANCELLED)
-                    std::cerr << "Failed to save file '" << get_filename() << "'" << std::endl
-                              << "  Error code: " << e.code() << std::endl;
+                try
+                {
+                    m_Loader->close();
+                }
+                catch (...)
+                {
+                }
+
+                if (Glib::RefPtr<Gdk::Pixbuf> p{ m_Loader->get_pixbuf() })
+                {
+                    std::scoped_lock pixbuf_lock{ m_Mutex };
+                    m_Pixbuf = p;
+                }
             }
-        });
+        }
+
+        m_ShowingSample = sample;
+        m_Loading       = false;
+        m_SignalPixbufChanged();
+        m_DownloadCond.notify_one();
     }
     else
     {
-        std::cerr << "Booru::Image::on_finished: Curler received no data yet finished!"
+        std::cerr << "Booru::Image::on_finished: Failed to download '" << get_filename() << "'"
                   << std::endl;
+
+        // Fall back to the original if the sample can't be downloaded
+        if (sample)
+        {
+            std::scoped_lock lock{ m_SampleMutex };
+            m_WantOriginal = true;
+        }
     }
 
+    m_Curler->clear();
     close_loader();
+
+    bool start_original;
+    {
+        std::scoped_lock lock{ m_SampleMutex };
+        m_DownloadingSample = false;
+        start_original      = sample && m_WantOriginal;
+    }
+
+    if (start_original)
+        start_download();
 }
 
 void Image::on_area_prepared()
@@ -314,7 +490,8 @@ void Image::on_area_prepared()
     }
     m_ThumbnailLock.unlock_shared();
 
-    if (!m_Curler.is_cancelled())
+    // The sample stays up until the original has finished
+    if (!m_Curler->is_cancelled() && !m_ShowingSample)
     {
         m_Pixbuf = m_Loader->get_pixbuf();
         m_SignalPixbufChanged();
@@ -329,16 +506,40 @@ void Image::on_area_updated(int, int, int, int)
     // but knowing for sure when gtk draws something seems impossible
     Glib::RefPtr<Gdk::Pixbuf> p = m_Loader->get_pixbuf();
     int ms = std::clamp((p->get_width() + p->get_height()) / 60.f, 100.f, 800.f);
-    if (!m_Curler.is_cancelled() && steady_clock::now() >= m_LastDraw + milliseconds(ms))
+    if (!m_Curler->is_cancelled() && !m_ShowingSample &&
+        steady_clock::now() >= m_LastDraw + milliseconds(ms))
     {
         m_SignalPixbufChanged();
         m_LastDraw = steady_clock::now();
     }
 }
 
+void Image::on_thumbnail_downloaded()
+{
+    if (std::exchange(m_ThumbnailPrefetching, false))
+        m_ThumbnailPrefetched = m_ThumbnailCurler->get_response() == CURLE_OK;
+
+    if (m_ThumbnailDownloaded)
+        std::exchange(m_ThumbnailDownloaded, nullptr)();
+}
+
 void Image::on_notes_downloaded()
 {
-    m_Notes = m_Site->parse_note_data(m_NotesCurler.get_data(), m_NotesCurler.get_data_size());
+    // Try again the next time the notes are wanted
+    if (m_NotesCurler->is_cancelled())
+    {
+        m_NotesRequested = false;
+        return;
+    }
+
+    m_Notes = m_Site->parse_note_data(m_NotesCurler->get_data(), m_NotesCurler->get_data_size());
+
+    if (m_NotesCurler->get_response() == CURLE_OK && m_NotesCurler->get_response_code() < 400)
+        m_Site->cache_notes(m_NotesCurler->get_url(), m_Notes);
+    else
+        m_NotesRequested = false;
+
+    m_NotesCurler->clear();
 
     if (m_Notes.size() > 0)
         m_SignalNotesChanged();
@@ -6,6 +6,7 @@
 #include "imagefetcher.h"
 
 #include <condition_variable>
+#include <functional>
 #include <shared_mutex>
 #include <vector>
 
@@ -22,6 +23,8 @@ namespace AhoViewer::Booru
     public:
         Image(std::string path,
               std::string url,
+              std::string sample_path,
+              std::string sample_url,
               std::string thumb_path,
               std::string thumb_url,
               std::string post_url,
@@ -41,13 +44,30 @@ namespace AhoViewer::Booru
         bool is_loading() const override;
         std::string get_filename() const override;
         const Glib::RefPtr<Gdk::Pixbuf>& get_thumbnail(Glib::RefPtr<Gio::Cancellable>) override;
+        // Starts downloading the thumbnail without waiting for it, cb is called on the main
+        // thread once it's done. Returns false if there is nothing to download
+        bool download_thumbnail(std::function<void()> cb);
+        // Downloads the thumbnail at the lowest priority before the image is in a list,
+        // download_thumbnail picks it up from there
+        void prefetch_thumbnail();
+        // Decodes the downloaded thumbnail, meant to be run on a worker thread
+        const Glib::RefPtr<Gdk::Pixbuf>& decode_thumbnail();
 
         void load_pixbuf(Glib::RefPtr<Gio::Cancellable> c) override;
         void reset_pixbuf() override;
+        void load_full_size() override;
 
         void save(const std::string& path);
         void cancel_download();
         void cancel_thumbnail_download();
+        // Cancels every transfer and adds the curlers that still need to be removed from the
+        // ImageFetcher to active
+        void cancel_transfers(std::vector<std::shared_ptr<Curler>>& active);
+        // The image being viewed is downloaded ahead of everything else
+        void set_foreground(const bool foreground);
+        // Fetches the notes the first time this is called, meant to be called once the image
+        // is current or being prefetched so posts that are never opened don't cost a request
+        void load_notes();
 
         SignalProgressType signal_progress() const { return m_SignalProgress; }
         SignalDownloadErrorType signal_download_error() const { return m_SignalDownloadError; }
@@ -56,6 +76,9 @@ namespace AhoViewer::Booru
 
     private:
         bool start_download();
+        // Makes every following download get the original and starts one if it hasn't been
+        // downloaded yet. A sample that is still downloading is left to finish first
+        void download_original();
         void close_loader();
 
         void on_write(const unsigned char* d, size_t l);
@@ -63,9 +86,10 @@ namespace AhoViewer::Booru
         void on_finished();
         void on_area_prepared();
         void on_area_updated(int, int, int, int);
+        void on_thumbnail_downloaded();
         void on_notes_downloaded();
 
-        std::string m_Url, m_ThumbnailUrl, m_PostUrl;
+        std::string m_Url, m_SampleUrl, m_SamplePath, m_ThumbnailUrl, m_PostUrl;
         std::vector<Tag> m_Tags;
         const PostInfo m_PostInfo;
         std::shared_ptr<Site> m_Site;
@@ -73,13 +97,25 @@ namespace AhoViewer::Booru
 
         time_point_t m_LastDraw;
 
-        Curler m_Curler, m_ThumbnailCurler, m_NotesCurler;
+        // Shared with the ImageFetcher when this is destroyed during a transfer
+        std::shared_ptr<Curler> m_Curler, m_ThumbnailCurler, m_NotesCurler;
         Glib::RefPtr<Gdk::PixbufLoader> m_Loader;
-        bool m_PixbufError{ false }, m_IsGifChecked{ false };
+        bool m_PixbufError{ false }, m_IsGifChecked{ false }, m_NotesRequested{ false };
+        std::atomic<bool> m_Foreground{ false };
+        // Whether m_Curler is downloading the sample and the original has been asked for,
+        // both guarded by m_SampleMutex. m_ShowingSample is set while m_Pixbuf is the
+        // sample, the original is then downloaded without replacing it until it's done
+        bool m_DownloadingSample{ false }, m_WantOriginal{ false };
+        std::atomic<bool> m_ShowingSample{ false };
+        std::mutex m_SampleMutex;
         std::shared_mutex m_ThumbnailLock;
 
-        std::condition_variable m_DownloadCond, m_ThumbnailCond;
-        std::mutex m_DownloadMutex, m_ThumbnailMutex;
+        std::function<void()> m_ThumbnailDownloaded;
+        // Only used on the main thread. Prefetching is set until the prefetched thumbnail
+        // finishes, then Prefetched is set if it downloaded successfully
+        bool m_ThumbnailPrefetching{ false }, m_ThumbnailPrefetched{ false };
+        std::condition_variable m_DownloadCond;
+        std::mutex m_DownloadMutex;
 
         SignalProgressType m_SignalProgress;
         SignalDownloadErrorType m_SignalDownloadError;
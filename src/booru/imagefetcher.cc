@@ -1,6 +1,20 @@
 #include "imagefetcher.h"
 using namespace AhoViewer::Booru;
 
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+    std::string get_host(const std::string& url)
+    {
+        size_t start{ url.find("://") };
+        start = start == std::string::npos ? 0 : start + 3;
+
+        return url.substr(start, url.find('/', start) - start);
+    }
+}
+
 int ImageFetcher::socket_cb(CURL*, curl_socket_t s, int action, void* userp, void* sockp)
 {
     auto* self{ static_cast<ImageFetcher*>(userp) };
@@ -56,10 +70,12 @@ int ImageFetcher::timer_cb(CURLM*, long timeout_ms, void* userp)
     return 0;
 }
 
-ImageFetcher::ImageFetcher(const bool multiplex)
+ImageFetcher::ImageFetcher(const bool multiplex, const int max_connections)
     : m_MainContext(Glib::MainContext::create()),
       m_MainLoop(Glib::MainLoop::create(m_MainContext)),
-      m_MultiHandle(curl_multi_init())
+      m_MultiHandle(curl_multi_init()),
+      m_MaxTransfers((max_connections > 0 ? max_connections : DefaultConnections) *
+                     (multiplex ? StreamsPerConnection : 1))
 {
     m_Thread = std::thread([&]() {
         auto added_dis   = std::make_shared<Glib::Dispatcher>(m_MainContext),
@@ -74,6 +90,8 @@ ImageFetcher::ImageFetcher(const bool multiplex)
         m_MainLoop->run();
     });
 
+    m_SignalHandlesRemoved.connect(sigc::mem_fun(*this, &ImageFetcher::on_handles_removed));
+
     curl_multi_setopt(m_MultiHandle, CURLMOPT_SOCKETFUNCTION, &ImageFetcher::socket_cb);
     curl_multi_setopt(m_MultiHandle, CURLMOPT_SOCKETDATA, this);
     curl_multi_setopt(m_MultiHandle, CURLMOPT_TIMERFUNCTION, &ImageFetcher::timer_cb);
@@ -83,6 +101,14 @@ ImageFetcher::ImageFetcher(const bool multiplex)
         curl_multi_setopt(m_MultiHandle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
     else
         curl_multi_setopt(m_MultiHandle, CURLMOPT_PIPELINING, CURLPIPE_NOTHING);
+
+    // Image hosts are often different from the site's API host, each one gets this many
+    const long host_connections{ max_connections > 0 ? max_connections : DefaultConnections };
+    curl_multi_setopt(m_MultiHandle, CURLMOPT_MAX_HOST_CONNECTIONS, host_connections);
+
+    // Curlers added before the thread has made its dispatchers had nothing to wake it up
+    m_MainContext->signal_idle().connect_once(
+        sigc::mem_fun(*this, &ImageFetcher::on_handle_added));
 }
 
 ImageFetcher::~ImageFetcher()
@@ -102,24 +128,56 @@ void ImageFetcher::shutdown()
     if (m_Thread.joinable())
         m_Thread.join();
 
-    for (Curler* c : m_Curlers)
-        remove_handle(c);
+    while (!m_Curlers.empty())
+        remove_handle(m_Curlers.begin()->first);
+
+    std::scoped_lock lock{ m_PendingMutex };
+    for (auto& [c, p] : m_Pending)
+        c->m_Active = false;
+    m_Pending.clear();
 }
 
-void ImageFetcher::add_handle(Curler* curler)
+void ImageFetcher::add_handle(Curler* curler, const Priority p)
 {
     if (m_Shutdown)
         return;
 
-    curler->m_Cancel->reset();
-    curler->clear();
-    curler->m_Active = true;
-    m_CurlerQueue.push(curler);
+    {
+        std::scoped_lock lock{ m_PendingMutex };
+        curler->m_Cancel->reset();
+        curler->clear();
+        curler->m_Active = true;
+
+        auto it{ std::find_if(m_Pending.begin(), m_Pending.end(), [&](const auto& c) {
+            return c.first == curler;
+        }) };
+
+        if (it != m_Pending.end())
+            it->second = p;
+        else
+            m_Pending.emplace_back(curler, p);
+    }
 
     if (auto dis = m_SignalHandleAdded.lock())
         dis->emit();
 }
 
+void ImageFetcher::cancel_handle(Curler* curler)
+{
+    std::scoped_lock lock{ m_PendingMutex };
+    curler->cancel();
+
+    auto it{ std::find_if(m_Pending.begin(), m_Pending.end(), [&](const auto& c) {
+        return c.first == curler;
+    }) };
+
+    if (it != m_Pending.end())
+    {
+        m_Pending.erase(it);
+        curler->m_Active = false;
+    }
+}
+
 void ImageFetcher::unpause_handle(Curler* curler)
 {
     if (m_Shutdown)
@@ -131,19 +189,183 @@ void ImageFetcher::unpause_handle(Curler* curler)
         dis->emit();
 }
 
+void ImageFetcher::set_priority(Curler* curler, const Priority p)
+{
+    if (m_Shutdown)
+        return;
+
+    bool pending{ false };
+    {
+        std::scoped_lock lock{ m_PendingMutex };
+        auto it{ std::find_if(m_Pending.begin(), m_Pending.end(), [&](const auto& c) {
+            return c.first == curler;
+        }) };
+
+        if (it != m_Pending.end())
+        {
+            it->second = p;
+            pending    = true;
+        }
+    }
+
+    // Already downloading
+    if (!pending)
+        m_PriorityQueue.emplace(curler, p);
+
+    if (auto dis = m_SignalHandleAdded.lock())
+        dis->emit();
+}
+
+void ImageFetcher::remove_handles(std::vector<std::shared_ptr<Curler>> curlers)
+{
+    if (m_Shutdown || curlers.empty())
+        return;
+
+    // Once this returns the curlers' owners are gone, a write that is already running has
+    // to finish before its handlers are disconnected
+    for (const auto& c : curlers)
+    {
+        c->cancel();
+
+        std::scoped_lock lock{ c->m_WriteMutex };
+        c->m_SignalWrite.clear();
+    }
+
+    // Shared so whichever copy of the slot is destroyed last doesn't own the curlers
+    auto removed{ std::make_shared<std::vector<std::shared_ptr<Curler>>>(std::move(curlers)) };
+
+    m_MainContext->invoke([&, removed]() {
+        // Anything still queued for these curlers has to be dealt with before they are gone
+        on_handle_unpause();
+        take_queued();
+
+        for (const auto& c : *removed)
+        {
+            cancel_handle(c.get());
+
+            if (m_Curlers.find(c.get()) != m_Curlers.end())
+                remove_handle(c.get());
+        }
+
+        start_pending();
+
+        // Their dispatchers have to be destroyed on the main thread
+        {
+            std::scoped_lock lock{ m_RemovedMutex };
+            std::move(removed->begin(), removed->end(), std::back_inserter(m_Removed));
+        }
+        removed->clear();
+        m_SignalHandlesRemoved.emit();
+
+        return false;
+    });
+}
+
+void ImageFetcher::on_handles_removed()
+{
+    std::vector<std::shared_ptr<Curler>> removed;
+    {
+        std::scoped_lock lock{ m_RemovedMutex };
+        removed.swap(m_Removed);
+    }
+}
+
 void ImageFetcher::on_handle_added()
 {
-    Curler* curler{ nullptr };
-    while (!m_Shutdown && m_CurlerQueue.pop(curler))
+    take_queued();
+    start_pending();
+}
+
+// Priority changes of curlers that are already downloading
+void ImageFetcher::take_queued()
+{
+    std::pair<Curler*, Priority> c;
+    while (!m_Shutdown && m_PriorityQueue.pop(c))
+        if (auto active{ m_Curlers.find(c.first) }; active != m_Curlers.end())
+            active->second = c.second;
+}
+
+// Starts the highest priority queued curlers, oldest first, until the limits are reached
+void ImageFetcher::start_pending()
+{
+    std::unique_lock<std::mutex> lock(m_PendingMutex);
+
+    // Curlers cancelled without cancel_handle, they have never been started so there is
+    // nothing to clean up
+    m_Pending.erase(std::remove_if(m_Pending.begin(),
+                                   m_Pending.end(),
+                                   [](const auto& p) {
+                                       const bool cancelled{ p.first->is_cancelled() };
+                                       if (cancelled)
+                                           p.first->m_Active = false;
+                                       return cancelled;
+                                   }),
+                    m_Pending.end());
+
+    while (!m_Shutdown && !m_Pending.empty())
     {
-        m_Curlers.push_back(curler);
+        auto it{ std::min_element(
+            m_Pending.begin(), m_Pending.end(), [](const auto& a, const auto& b) {
+                return a.second < b.second;
+            }) };
+
+        Curler* curler{ it->first };
+
+        // Added again while it was still downloading
+        if (m_Curlers.find(curler) != m_Curlers.end())
+        {
+            m_Pending.erase(it);
+            continue;
+        }
+
+        // Anything lower than this can't start either
+        if (!can_start(it->second))
+            break;
+
+        m_Curlers.emplace(*it);
+        m_Pending.erase(it);
+
+        // Adding the handle can run libcurl's callbacks, which may end up back in here
+        // or cancelling a curler
+        lock.unlock();
         curler->set_imagefetcher(this);
         curler->m_DownloadCurrent = curler->m_DownloadTotal = 0;
         curler->m_StartTime                                 = std::chrono::steady_clock::now();
         curl_multi_add_handle(m_MultiHandle, curler->m_EasyHandle);
+        lock.lock();
     }
 }
 
+bool ImageFetcher::can_start(const Priority p) const
+{
+    if (m_Curlers.size() >= m_MaxTransfers)
+        return false;
+    if (p == Priority::IMAGE)
+        return true;
+
+    // Keep a transfer free for the image being viewed, unless that's the only one
+    if (m_MaxTransfers > 1 && m_Curlers.size() + 1 >= m_MaxTransfers)
+        return false;
+
+    if (p >= Priority::THUMBNAIL)
+    {
+        size_t foreground{ 0 }, background{ 0 };
+        for (const auto& [c, cp] : m_Curlers)
+        {
+            if (cp == Priority::IMAGE)
+                ++foreground;
+            else if (cp >= Priority::THUMBNAIL)
+                ++background;
+        }
+
+        // Thumbnails and notes only trickle in while the viewed image downloads
+        if (foreground > 0 && background >= ThrottledTransfers)
+            return false;
+    }
+
+    return true;
+}
+
 void ImageFetcher::on_handle_unpause()
 {
     Curler* curler{ nullptr };
@@ -154,16 +376,17 @@ void ImageFetcher::on_handle_unpause()
     }
 }
 
-void ImageFetcher::remove_handle(Curler* curler)
+void ImageFetcher::remove_handle(Curler* curler, const bool deactivate)
 {
     if (!curler)
         return;
 
     curl_multi_remove_handle(m_MultiHandle, curler->m_EasyHandle);
-    m_Curlers.erase(std::remove(m_Curlers.begin(), m_Curlers.end(), curler), m_Curlers.end());
+    m_Curlers.erase(curler);
 
-    curler->m_Active = false;
     curler->set_imagefetcher(nullptr);
+    if (deactivate)
+        curler->m_Active = false;
 }
 
 bool ImageFetcher::event_cb(curl_socket_t sockfd, Glib::IOCondition cond)
@@ -205,14 +428,74 @@ void ImageFetcher::read_info()
 
             if (curler)
             {
-                remove_handle(curler);
+                auto it{ m_Curlers.find(curler) };
+                const bool image{ it != m_Curlers.end() && (it->second == Priority::IMAGE ||
+                                                            it->second == Priority::PREFETCH) };
+
+                remove_handle(curler, false);
                 curler->m_Response = msg->data.result;
 
-                if (!curler->is_cancelled())
-                    curler->m_SignalFinished();
-                else
+                if (image && curler->m_Response == CURLE_OK && !curler->is_cancelled())
+                    record_transfer(curler);
+
+                curler->close_output(curler->m_Response == CURLE_OK && !curler->is_cancelled() &&
+                                     curler->get_response_code() < 400);
+
+                const bool cancelled{ curler->is_cancelled() };
+                if (cancelled)
                     curler->clear();
+
+                // The main thread can reuse the curler as soon as it's inactive, so this has
+                // to wait until its output file has been dealt with
+                curler->m_Active = false;
+
+                if (!cancelled)
+                    curler->m_SignalFinished();
             }
         }
     }
+
+    start_pending();
+}
+
+bool ImageFetcher::prefer_samples(const std::string& url) const
+{
+    std::scoped_lock lock{ m_StatsMutex };
+    auto it{ m_HostStats.find(get_host(url)) };
+
+    // Nothing is known about the host yet, play it safe. The first sample
+    // downloaded from it is measured and decides the next one
+    if (it == m_HostStats.end() || it->second.count == 0)
+        return true;
+
+    const HostStats& s{ it->second };
+    const double throughput{ s.bytes / s.seconds };
+
+    return s.first_byte + TypicalOriginalSize / throughput > MaxOriginalWait;
+}
+
+// Every image counts, weighted by its size. Small downloads are mostly waiting for the
+// first byte and would make the host look slower than it is if they counted as much as
+// large ones. Skipping them instead would leave hosts that only serve small samples
+// without any measurements, and prefer_samples would never try an original
+void ImageFetcher::record_transfer(Curler* curler)
+{
+    curl_off_t size, first_byte, total;
+    curl_easy_getinfo(curler->m_EasyHandle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+    curl_easy_getinfo(curler->m_EasyHandle, CURLINFO_STARTTRANSFER_TIME_T, &first_byte);
+    curl_easy_getinfo(curler->m_EasyHandle, CURLINFO_TOTAL_TIME_T, &total);
+
+    if (size <= 0)
+        return;
+
+    const std::string host{ get_host(curler->get_url()) };
+    std::scoped_lock lock{ m_StatsMutex };
+    HostStats& s{ m_HostStats[host] };
+
+    // Recent downloads count for more, the first one is taken as is
+    const double weight{ s.count == 0 ? 1 : 1 - StatsDecay };
+    s.bytes      = s.bytes * StatsDecay + size;
+    s.seconds    = s.seconds * StatsDecay + std::max(total - first_byte, curl_off_t{ 1 }) / 1e6;
+    s.first_byte = s.first_byte * (1 - weight) + first_byte / 1e6 * weight;
+    ++s.count;
 }
@@ -3,22 +3,60 @@
 #include "curler.h"
 #include "tsqueue.h"
 
+#include <mutex>
 #include <thread>
+#include <unordered_map>
 
 namespace AhoViewer::Booru
 {
     class ImageFetcher : public sigc::trackable
     {
     public:
-        ImageFetcher(const bool multiplex);
+        // Transfers are started in this order, lower ones wait while the image being viewed
+        // is downloading
+        enum class Priority
+        {
+            IMAGE,
+            PREFETCH,
+            THUMBNAIL,
+            NOTES,
+            // Thumbnails of a page that hasn't been shown yet
+            SPECULATIVE,
+        };
+
+        // max_connections is the site's limit per host, 0 uses the default
+        ImageFetcher(const bool multiplex, const int max_connections = 0);
         virtual ~ImageFetcher();
 
         void shutdown();
 
-        void add_handle(Curler* curler);
+        void add_handle(Curler* curler, const Priority p = Priority::IMAGE);
+        // Cancels the curler, one that hasn't been started yet is dropped right away so it
+        // can be added again without waiting for the fetcher thread
+        void cancel_handle(Curler* curler);
         void unpause_handle(Curler* curler);
+        // Changes the priority of a curler that is queued or downloading
+        void set_priority(Curler* curler, const Priority p);
+        // Stops the curlers and removes them on the fetcher thread without waiting for it.
+        // The fetcher keeps them alive until then and lets go of them on the main thread.
+        // Several tabs share one fetcher, so this is used instead of shutdown when a tab is
+        // done with its curlers
+        void remove_handles(std::vector<std::shared_ptr<Curler>> curlers);
+
+        // Whether an image from url's host should be downloaded as a sample, based on the
+        // throughput and time to first byte of the images already downloaded from it.
+        // Can be called from any thread
+        bool prefer_samples(const std::string& url) const;
 
     private:
+        // Decaying totals of finished image downloads, throughput is bytes / seconds
+        // so each download counts as much as its size. first_byte is a moving average
+        struct HostStats
+        {
+            double bytes{ 0 }, seconds{ 0 }, first_byte{ 0 };
+            size_t count{ 0 };
+        };
+
         struct SockInfo
         {
             ~SockInfo()
@@ -35,24 +73,53 @@ namespace AhoViewer::Booru
         static int socket_cb(CURL*, curl_socket_t s, int action, void* userp, void* sockp);
         static int timer_cb(CURLM*, long timeout_ms, void* userp);
 
+        void on_handles_removed();
         void on_handle_added();
         void on_handle_unpause();
-        void remove_handle(Curler* curler);
+        void take_queued();
+        void start_pending();
+        bool can_start(const Priority p) const;
+        // deactivate is false when the caller still has to finish up with the curler
+        void remove_handle(Curler* curler, const bool deactivate = true);
         bool event_cb(curl_socket_t sockfd, Glib::IOCondition cond);
         bool timeout_cb();
         void read_info();
+        void record_transfer(Curler* curler);
 
         Glib::RefPtr<Glib::MainContext> m_MainContext;
         Glib::RefPtr<Glib::MainLoop> m_MainLoop;
         std::thread m_Thread;
 
+        static constexpr size_t DefaultConnections{ 6 }, StreamsPerConnection{ 4 },
+                                ThrottledTransfers{ 1 };
+        // Weight kept by the earlier downloads' stats each time a new one is recorded
+        static constexpr double StatsDecay{ 0.7 };
+        // Originals are assumed to be this large, samples are used when one would take longer
+        // than MaxOriginalWait seconds to download
+        static constexpr double TypicalOriginalSize{ 4 * 1024 * 1024 }, MaxOriginalWait{ 2 };
+
         CURLM* m_MultiHandle;
         int m_RunningHandles{ 0 };
-        TSQueue<Curler*> m_CurlerQueue, m_CurlerUnpauseQueue;
-        std::vector<Curler*> m_Curlers;
+        TSQueue<std::pair<Curler*, Priority>> m_PriorityQueue;
+        TSQueue<Curler*> m_CurlerUnpauseQueue;
+
+        // Added curlers wait in m_Pending and are started from it on m_Thread, in priority
+        // order, whenever there is room for them. m_Curlers is only touched on m_Thread
+        std::vector<std::pair<Curler*, Priority>> m_Pending;
+        std::unordered_map<Curler*, Priority> m_Curlers;
+        size_t m_MaxTransfers;
+        std::mutex m_PendingMutex;
 
         std::weak_ptr<Glib::Dispatcher> m_SignalHandleAdded, m_SignalHandleUnpause;
 
+        // Curlers given to remove_handles wait here for the main thread to destroy them
+        std::vector<std::shared_ptr<Curler>> m_Removed;
+        std::mutex m_RemovedMutex;
+        Glib::Dispatcher m_SignalHandlesRemoved;
+
+        std::unordered_map<std::string, HostStats> m_HostStats;
+        mutable std::mutex m_StatsMutex;
+
         std::atomic<bool> m_Shutdown{ false };
 
         sigc::connection m_TimeoutConn;
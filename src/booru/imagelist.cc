@@ -7,6 +7,7 @@ using namespace AhoViewer::Booru;
 #include "site.h"
 #include "tempdir.h"
 
+#include <algorithm>
 #include <chrono>
 
 ImageList::ImageList(Widget* w) : AhoViewer::ImageList(w) { }
@@ -23,9 +24,18 @@ void ImageList::clear()
 {
     cancel_thumbnail_thread();
 
-    // This prepares the imagefetcher for a clean death
+    // Take this tab's transfers out of the shared fetcher in one go, some of the images
+    // may be kept alive a little longer by the cache
     if (m_ImageFetcher)
-        m_ImageFetcher->shutdown();
+    {
+        std::vector<std::shared_ptr<Curler>> active;
+        for (const auto& img : m_Images)
+            std::static_pointer_cast<Image>(img)->cancel_transfers(active);
+        for (const auto& img : m_Prepared)
+            img->cancel_transfers(active);
+
+        m_ImageFetcher->remove_handles(std::move(active));
+    }
 
     // Clears the image vector and widget (Booru::Page)
     AhoViewer::ImageList::clear();
@@ -36,8 +46,10 @@ void ImageList::clear()
         m_Path.clear();
     }
 
-    m_Size         = 0;
-    m_ImageFetcher = nullptr;
+    m_Prepared.clear();
+    m_PreparedSkipped = 0;
+    m_Size            = 0;
+    m_ImageFetcher    = nullptr;
 }
 
 std::string ImageList::get_path()
@@ -46,24 +58,70 @@ std::string ImageList::get_path()
     {
         m_Path = TempDir::get_instance().make_dir();
         g_mkdir_with_parents(Glib::build_filename(m_Path, "thumbnails").c_str(), 0755);
+        g_mkdir_with_parents(Glib::build_filename(m_Path, "samples").c_str(), 0755);
     }
 
     return m_Path;
 }
 
+void ImageList::prepare(const std::vector<PostDataTuple>& posts)
+{
+    m_Prepared = create_images(posts, m_PreparedSkipped);
+
+    for (const auto& img : m_Prepared)
+        img->prefetch_thumbnail();
+}
+
 void ImageList::load(const std::vector<PostDataTuple>& posts, const size_t posts_count)
 {
     auto page{ static_cast<Page*>(m_Widget) };
+    size_t skipped{ m_PreparedSkipped };
+    std::vector<std::shared_ptr<Image>> images;
 
-    if (!m_ImageFetcher)
-        m_ImageFetcher = std::make_unique<ImageFetcher>(page->get_site()->get_multiplexing());
+    if (!m_Prepared.empty())
+        images = std::move(m_Prepared);
+    else
+        images = create_images(posts, skipped);
+
+    m_Prepared.clear();
+    m_PreparedSkipped = 0;
 
     auto old_size{ m_Images.size() };
-    m_Size = posts_count;
+    // Posts with unsupported file types are left out of the total
+    m_Size = posts_count - std::min(posts_count, skipped);
+    m_Images.insert(m_Images.end(), images.begin(), images.end());
+
+    if (m_Images.empty())
+        return;
+
+    m_Widget->reserve(m_Images.size() - old_size);
+    load_thumbnails();
+
+    // Select the first image on initial load
+    if (page->get_page_num() == 1)
+    {
+        set_current(m_Index, false, true);
+    }
+    else
+    {
+        m_SignalChanged(m_Images[m_Index]);
+    }
+}
+
+// skipped is set to the number of posts with unsupported file types
+std::vector<std::shared_ptr<Image>>
+ImageList::create_images(const std::vector<PostDataTuple>& posts, size_t& skipped)
+{
+    auto page{ static_cast<Page*>(m_Widget) };
+    std::vector<std::shared_ptr<Image>> images;
+    skipped = 0;
+
+    if (!m_ImageFetcher)
+        m_ImageFetcher = page->get_site()->get_image_fetcher();
 
     for (const auto& post : posts)
     {
-        auto [image_url, thumb_url, post_url, notes_url, tags, post_info]{ post };
+        auto [image_url, sample_url, thumb_url, post_url, notes_url, tags, post_info]{ post };
         auto junk_trimmed_image_url{ image_url };
 
         // Some file urls may have uri parameters, trim them so is_valid_extension works
@@ -73,8 +131,7 @@ void ImageList::load(const std::vector<PostDataTuple>& posts, const size_t posts
         // Check this before we do tag stuff since it would waste time
         if (!Image::is_valid_extension(junk_trimmed_image_url))
         {
-            if (m_Size != 0)
-                --m_Size;
+            ++skipped;
             continue;
         }
 
@@ -85,58 +142,101 @@ void ImageList::load(const std::vector<PostDataTuple>& posts, const size_t posts
         auto image_path{ Glib::build_filename(
             get_path(),
             Glib::uri_unescape_string(Glib::path_get_basename(junk_trimmed_image_url))) };
-
-        m_Images.push_back(std::make_shared<Image>(image_path,
-                                                   image_url,
-                                                   thumb_path,
-                                                   thumb_url,
-                                                   post_url,
-                                                   notes_url,
-                                                   tags,
-                                                   post_info,
-                                                   page->get_site(),
-                                                   *m_ImageFetcher));
+        std::string sample_path;
+
+        if (!sample_url.empty())
+            sample_path = Glib::build_filename(
+                get_path(),
+                "samples",
+                Glib::uri_unescape_string(
+                    Glib::path_get_basename(sample_url.substr(0, sample_url.find_last_of('?')))));
+
+        images.push_back(std::make_shared<Image>(image_path,
+                                                 image_url,
+                                                 sample_path,
+                                                 sample_url,
+                                                 thumb_path,
+                                                 thumb_url,
+                                                 post_url,
+                                                 notes_url,
+                                                 tags,
+                                                 post_info,
+                                                 page->get_site(),
+                                                 *m_ImageFetcher));
     }
 
-    if (m_Images.empty())
-        return;
-
-    m_Widget->reserve(m_Images.size() - old_size);
-
-    if (m_ThumbnailThread.joinable())
-        m_ThumbnailThread.join();
-
-    m_ThumbnailThread = std::thread(sigc::mem_fun(*this, &ImageList::load_thumbnails));
-
-    // Select the first image on initial load
-    if (page->get_page_num() == 1)
-    {
-        set_current(m_Index, false, true);
-    }
-    else
-    {
-        m_SignalChanged(m_Images[m_Index]);
-    }
+    return images;
 }
 
-// Override this so we dont cancel and restart the thumbnail thread
+// Booru lists have no archive to read ahead in or prefetch neighbours of
 void ImageList::set_current(const size_t index, const bool from_widget, const bool force)
 {
     if (index == m_Index && !force)
         return;
 
+    if (m_Index < m_Images.size())
+        std::static_pointer_cast<Image>(m_Images[m_Index])->set_foreground(false);
+    std::static_pointer_cast<Image>(m_Images[index])->set_foreground(true);
+
     m_Index = index;
     m_SignalChanged(m_Images[m_Index]);
     update_cache();
+    set_thumbnail_focus(m_Index);
+
+    for (const size_t i : get_cached_indices())
+        std::static_pointer_cast<Image>(m_Images[i])->load_notes();
 
     if (!from_widget)
         m_Widget->set_selected(m_Index);
 }
 
+// Thumbnails are downloaded without holding on to a worker, only decoding the finished
+// download is done on the executor. Another download is started each time one finishes
+// so the ones closest to the current image always go next.
+void ImageList::schedule_thumbnails(size_t)
+{
+    size_t i;
+    std::shared_ptr<AhoViewer::Image> image;
+    while (m_ThumbnailDownloads < MaxThumbnailDownloads && take_thumbnail(i, image))
+    {
+        auto bimage{ std::static_pointer_cast<Image>(image) };
+
+        if (bimage->download_thumbnail(
+                [this, i, g = m_ThumbnailGeneration]() { on_thumbnail_downloaded(i, g); }))
+            ++m_ThumbnailDownloads;
+        else
+            queue_thumbnail_decode(i, bimage);
+    }
+}
+
+// Rows are only ever appended to booru lists, i is still the same row if the
+// generation hasn't changed
+void ImageList::on_thumbnail_downloaded(const size_t i, const size_t generation)
+{
+    if (generation != m_ThumbnailGeneration)
+        return;
+
+    --m_ThumbnailDownloads;
+    queue_thumbnail_decode(i, std::static_pointer_cast<Image>(m_Images[i]));
+
+    schedule_thumbnails(0);
+}
+
+void ImageList::queue_thumbnail_decode(const size_t i, const std::shared_ptr<Image>& bimage)
+{
+    m_ThumbnailExecutor.push([this, i, bimage]() { add_thumbnail(i, bimage->decode_thumbnail()); },
+                             Executor::Priority::PREFETCH);
+}
+
 // Cancel all image thumbnail curlers.
 void ImageList::cancel_thumbnail_thread()
 {
-    m_ThumbnailCancel->cancel();
+    // Stops the decode tasks and drops their finished thumbnails, the cancellable is
+    // reset by the next load_thumbnails so nothing from before may still be running
+    AhoViewer::ImageList::cancel_thumbnail_thread();
+
+    ++m_ThumbnailGeneration;
+    m_ThumbnailDownloads = 0;
 
     for (auto img : *this)
     {
@@ -5,6 +5,7 @@
 
 namespace AhoViewer::Booru
 {
+    class Image;
     class ImageFetcher;
     class Page;
     class Site;
@@ -23,16 +24,40 @@ namespace AhoViewer::Booru
 
         void clear() override;
         void load(const std::vector<PostDataTuple>& posts, const size_t posts_count = 0);
-        bool is_loading() const { return m_ThreadPool.active(); }
+        // Creates the images for posts ahead of time and starts prefetching their thumbnails,
+        // the next load() call adds them instead of creating new ones
+        void prepare(const std::vector<PostDataTuple>& posts);
+        bool is_loading() const { return thumbnails_loading(); }
 
     protected:
         void set_current(const size_t index,
                          const bool from_widget = false,
                          const bool force       = false) override;
         void cancel_thumbnail_thread() override;
+        void schedule_thumbnails(size_t) override;
+        bool thumbnails_loading() const override
+        {
+            return m_ThumbnailDownloads > 0 || m_ThumbnailExecutor.active();
+        }
 
     private:
-        std::unique_ptr<ImageFetcher> m_ImageFetcher;
+        std::vector<std::shared_ptr<Image>> create_images(const std::vector<PostDataTuple>& posts,
+                                                          size_t& skipped);
+        void on_thumbnail_downloaded(const size_t i, const size_t generation);
+        void queue_thumbnail_decode(const size_t i, const std::shared_ptr<Image>& bimage);
+
+        // Thumbnails downloading at once, the ImageFetcher decides how many of them are
+        // actually transferring
+        static constexpr size_t MaxThumbnailDownloads{ 16 };
+
+        // Owned by the site and shared with every other tab browsing it
+        std::shared_ptr<ImageFetcher> m_ImageFetcher;
+        // Only used on the main thread, the generation is bumped when thumbnails are
+        // cancelled so downloads finishing afterwards are ignored
+        size_t m_ThumbnailDownloads{ 0 }, m_ThumbnailGeneration{ 0 };
+
+        std::vector<std::shared_ptr<Image>> m_Prepared;
+        size_t m_PreparedSkipped{ 0 };
 
         std::string m_Path;
         // This is the total number of posts for the given booru query
@@ -2,13 +2,15 @@
 using namespace AhoViewer::Booru;
 
 #include "curler.h"
+#include "executor.h"
 #include "image.h"
+#include "responsecache.h"
 #include "settings.h"
 #include "site.h"
-#include "threadpool.h"
 
 #include <glibmm/i18n.h>
 #include <iostream>
+#include <utility>
 
 #define RETRY_COUNT 5
 
@@ -158,10 +160,13 @@ void Page::search(const std::shared_ptr<Site>& site)
     if (m_GetPostsThread.joinable())
         m_GetPostsThread.join();
 
-    m_Site       = site;
-    m_Page       = 1;
-    m_LastPage   = false;
-    m_SearchTags = m_Tags;
+    m_Site           = site;
+    m_Page           = 1;
+    m_LastPage       = false;
+    m_NextPageReady  = false;
+    m_NextPageWanted = false;
+    m_SearchTags     = m_Tags;
+    m_Posts.clear();
 
     // Trim leading and trailing whitespace for tab label
     // and m_SearchTags which is used to display tags in other places
@@ -205,21 +210,24 @@ void Page::save_images(const std::string& path)
     m_SaveImagesCurrent = 0;
     m_SaveImagesTotal   = m_ImageList->get_vector_size();
     m_SaveImagesThread  = std::thread([&, path]() {
-        ThreadPool pool;
+        // Saving waits on downloads so it only gets a share of the shared executor
+        Executor::Client pool{ std::max(Executor::get_instance().size() / 2, size_t{ 1 }) };
         for (const std::shared_ptr<AhoViewer::Image>& img : *m_ImageList)
         {
-            pool.push([&, path, img]() {
-                if (m_SaveCancel->is_cancelled())
-                    return;
-
-                std::shared_ptr<Image> bimage = std::static_pointer_cast<Image>(img);
-                bimage->save(
-                    Glib::build_filename(path, Glib::path_get_basename(bimage->get_filename())));
-                ++m_SaveImagesCurrent;
-
-                if (!m_SaveCancel->is_cancelled())
-                    m_SignalSaveProgressDisp();
-            });
+            pool.push(
+                [&, path, img]() {
+                    if (m_SaveCancel->is_cancelled())
+                        return;
+
+                    std::shared_ptr<Image> bimage = std::static_pointer_cast<Image>(img);
+                    bimage->save(Glib::build_filename(
+                        path, Glib::path_get_basename(bimage->get_filename())));
+                    ++m_SaveImagesCurrent;
+
+                    if (!m_SaveCancel->is_cancelled())
+                        m_SignalSaveProgressDisp();
+                },
+                Executor::Priority::BACKGROUND);
         }
 
         m_SignalSaveProgressDisp();
@@ -265,7 +273,9 @@ void Page::cancel_save()
 void Page::get_posts()
 {
     std::string tags{ m_SearchTags };
-    m_KeepAligned = true;
+
+    if (m_Page == 1)
+        m_KeepAligned = true;
 
     if (m_Tags.find("rating:") == std::string::npos)
     {
@@ -281,7 +291,12 @@ void Page::get_posts()
 
     tags = m_Curler.escape(tags);
 
-    m_GetPostsThread = std::thread([&, tags]() {
+    // A fresh cached response is used without calling perform, which is what would
+    // otherwise reset the cancellation from the previous search
+    m_Curler.reset_cancel();
+
+    const size_t fetch{ ++m_PostsFetch };
+    m_GetPostsThread = std::thread([&, tags, fetch]() {
         // DanbooruV2 doesn't give the post count with the posts
         // Get it from thier counts api
         if (m_Page == 1 && m_Site->get_type() == Type::DANBOORU_V2)
@@ -301,7 +316,10 @@ void Page::get_posts()
                 }
                 catch (const std::runtime_error& e)
                 {
-                    std::cerr << e.what() << std::endl << m_Curler.get_data() << std::endl;
+                    std::cerr << e.what() << std::endl
+                              << std::string(reinterpret_cast<char*>(m_Curler.get_data()),
+                                             m_Curler.get_data_size())
+                              << std::endl;
                 }
                 catch (const std::invalid_argument& e)
                 {
@@ -315,29 +333,77 @@ void Page::get_posts()
             }
         }
 
-        m_Curler.set_url(m_Site->get_posts_url(tags, m_Page));
+        const std::string url{ m_Site->get_posts_url(tags, m_Page) };
+        // Responses are cached per account since they can differ between them
+        const std::string account{ m_Site->get_username() };
+        auto& cache{ ResponseCache::get_instance() };
+        ResponseCache::Entry cached;
+        const bool have_cached{ cache.lookup(url, account, cached) };
+
+        auto parse_posts{ [&](unsigned char* data, const size_t size) {
+            auto [posts, posts_count, error]{ m_Site->parse_post_data(data, size) };
+            m_Posts = std::move(posts);
+            if (posts_count > 0)
+                m_PostsCount = posts_count;
+            m_PostsError = error;
+        } };
+
+        if (have_cached && cached.is_fresh())
+        {
+            parse_posts(reinterpret_cast<unsigned char*>(cached.data.data()), cached.data.size());
+            if (!m_Curler.is_cancelled())
+            {
+                m_PostsFetched = fetch;
+                m_SignalPostsDownloaded();
+            }
+            return;
+        }
+
+        m_Curler.set_url(url);
 
         if (m_Site->get_type() == Type::GELBOORU)
             m_Curler.set_cookie_file(m_Site->get_cookie());
         else
             m_Curler.set_http_auth(m_Site->get_username(), m_Site->get_password());
 
+        // A stale entry can still be used if the server says it hasn't changed
+        if (have_cached)
+            m_Curler.set_headers(cached.get_validators());
+
         bool success{ false };
         size_t retry_count{ 0 };
         do
         {
             success = m_Curler.perform();
-            if (success)
+            if (success && have_cached && m_Curler.get_response_code() == 304)
             {
-                auto [posts, posts_count, error]{ m_Site->parse_post_data(
-                    m_Curler.get_data(), m_Curler.get_data_size()) };
-                m_Posts = std::move(posts);
-                if (posts_count > 0)
-                    m_PostsCount = posts_count;
-                m_PostsError = error;
+                if (std::string etag{ m_Curler.get_header("ETag") }; !etag.empty())
+                    cached.etag = std::move(etag);
+
+                parse_posts(reinterpret_cast<unsigned char*>(cached.data.data()),
+                            cached.data.size());
+                cache.store(url, account, std::move(cached), m_Curler.get_header("Cache-Control"));
+            }
+            else if (success)
+            {
+                parse_posts(m_Curler.get_data(), m_Curler.get_data_size());
+
+                if (m_Curler.get_response_code() == 200 && m_PostsError.empty())
+                {
+                    ResponseCache::Entry entry;
+                    entry.etag          = m_Curler.get_header("ETag");
+                    entry.last_modified = m_Curler.get_header("Last-Modified");
+                    entry.data.assign(reinterpret_cast<char*>(m_Curler.get_data()),
+                                      m_Curler.get_data_size());
+
+                    cache.store(
+                        url, account, std::move(entry), m_Curler.get_header("Cache-Control"));
+                }
             }
         } while (!m_Curler.is_cancelled() && !success && ++retry_count < RETRY_COUNT);
 
+        m_Curler.set_headers({});
+
         if (!success && !m_Curler.is_cancelled())
         {
             std::cerr << "Error while downloading posts on " << m_Curler.get_url() << std::endl
@@ -348,21 +414,35 @@ void Page::get_posts()
         }
 
         if (!m_Curler.is_cancelled())
+        {
+            m_PostsFetched = fetch;
             m_SignalPostsDownloaded();
+        }
     });
 }
 
 bool Page::get_next_page()
 {
-    // Do not fetch the next page if this is the last
-    // or the current page is still loading
-    if (m_LastPage || m_GetPostsThread.joinable() || m_ImageList->is_loading())
+    if (!m_NextPageReady)
+    {
+        // It will be added as soon as it's done downloading
+        if (m_GetPostsThread.joinable())
+            m_NextPageWanted = true;
+        // The previous page failed to download, move on to the one after it
+        else if (!m_LastPage && m_Page > 1)
+        {
+            ++m_Page;
+            m_NextPageWanted = true;
+            get_posts();
+        }
+
         return false;
+    }
 
     if (!m_Saving)
     {
-        ++m_Page;
-        get_posts();
+        m_KeepAligned = true;
+        append_posts();
 
         return false;
     }
@@ -375,9 +455,12 @@ bool Page::get_next_page()
     return true;
 }
 
-// Adds the downloaded posts to the image list.
-void Page::on_posts_downloaded()
+// Adds the downloaded posts to the image list and starts downloading the next page
+void Page::append_posts()
 {
+    bool added{ false };
+    m_NextPageReady = false;
+
     if (!m_PostsError.empty())
     {
         m_SignalDownloadError(m_PostsError);
@@ -409,11 +492,42 @@ void Page::on_posts_downloaded()
 
             m_LastPage = true;
         }
+
+        added = n_posts > 0;
     }
 
-    m_Curler.clear();
     m_Posts.clear();
+
+    if (added)
+    {
+        ++m_Page;
+        get_posts();
+    }
+}
+
+void Page::on_posts_downloaded()
+{
+    // Left over from a fetch that search has replaced, or one that was already handled by an
+    // earlier stale callback
+    if (m_PostsFetched != m_PostsFetch || !m_GetPostsThread.joinable())
+        return;
+
     m_GetPostsThread.join();
+    m_Curler.clear();
+
+    if (m_Page == 1)
+    {
+        append_posts();
+        return;
+    }
+
+    // Parsed and with its thumbnails downloading, ready to be added right away
+    m_NextPageReady = true;
+    if (m_PostsError.empty() && !m_Posts.empty())
+        m_ImageList->prepare(m_Posts);
+
+    if (std::exchange(m_NextPageWanted, false))
+        get_next_page();
 }
 
 void Page::on_selection_changed()
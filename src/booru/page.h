@@ -102,6 +102,8 @@ namespace AhoViewer::Booru
         Gtk::Widget* get_tab() const { return m_Tab; }
         bool is_saving() const { return m_Saving; }
 
+        void append_posts();
+
         void on_posts_downloaded();
         void on_selection_changed();
         void on_value_changed();
@@ -127,7 +129,15 @@ namespace AhoViewer::Booru
         std::atomic<size_t> m_SaveImagesCurrent{ 0 };
         std::atomic<bool> m_Saving{ false };
         bool m_LastPage{ false }, m_KeepAligned{ false };
+        // Pages after the first are downloaded as soon as the previous one is added and kept
+        // in m_Posts until they are needed. Wanted is set when the page was asked for before
+        // it finished downloading
+        bool m_NextPageReady{ false }, m_NextPageWanted{ false };
         std::vector<PostDataTuple> m_Posts;
+        // Every get_posts is numbered, the thread sets Fetched to its number before emitting
+        // m_SignalPostsDownloaded so callbacks for older fetches can be told apart
+        size_t m_PostsFetch{ 0 };
+        std::atomic<size_t> m_PostsFetched{ 0 };
 
         Glib::RefPtr<Gio::Cancellable> m_SaveCancel;
         std::thread m_GetPostsThread, m_SaveImagesThread;
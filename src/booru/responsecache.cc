@@ -0,0 +1,198 @@
+#include "responsecache.h"
+using namespace AhoViewer::Booru;
+
+#include "config.h"
+
+#include <algorithm>
+#include <glib/gstdio.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Bump this if the entry format below changes, old entries will be ignored
+#define CACHE_VERSION "2"
+
+const std::string ResponseCache::CacheDir =
+    Glib::build_filename(Glib::get_user_cache_dir(), PACKAGE, "responses");
+
+std::vector<std::string> ResponseCache::Entry::get_validators() const
+{
+    std::vector<std::string> headers;
+
+    if (!etag.empty())
+        headers.push_back("If-None-Match: " + etag);
+    if (!last_modified.empty())
+        headers.push_back("If-Modified-Since: " + last_modified);
+
+    return headers;
+}
+
+bool ResponseCache::lookup(const std::string& url, const std::string& account, Entry& entry)
+{
+    std::scoped_lock lock{ m_Mutex };
+    const std::string path{ get_path(url, account) };
+    std::string contents;
+
+    try
+    {
+        contents = Glib::file_get_contents(path);
+    }
+    catch (const Glib::FileError&)
+    {
+        return false;
+    }
+
+    // The header lines are followed by the response body
+    std::istringstream ss{ contents };
+    std::string version, entry_url, entry_account, fetched, max_age;
+
+    if (!std::getline(ss, version) || version != "# " PACKAGE " response cache " CACHE_VERSION ||
+        !std::getline(ss, entry_url) || entry_url != url || !std::getline(ss, entry_account) ||
+        entry_account != account || !std::getline(ss, fetched) ||
+        !std::getline(ss, max_age) || !std::getline(ss, entry.etag) ||
+        !std::getline(ss, entry.last_modified))
+        return false;
+
+    try
+    {
+        entry.fetched = std::stoll(fetched);
+        entry.max_age = std::stoll(max_age);
+    }
+    catch (const std::logic_error&)
+    {
+        return false;
+    }
+
+    const auto pos{ ss.tellg() };
+    if (pos < 0)
+        return false;
+
+    entry.data = contents.substr(static_cast<size_t>(pos));
+
+    // Pruning goes by mtime, so mark it as recently used
+    g_utime(path.c_str(), nullptr);
+
+    return true;
+}
+
+void ResponseCache::store(const std::string& url,
+                          const std::string& account,
+                          Entry entry,
+                          const std::string& cache_control)
+{
+    std::scoped_lock lock{ m_Mutex };
+    const std::string path{ get_path(url, account) };
+
+    if (cache_control.find("no-store") != std::string::npos)
+    {
+        g_unlink(path.c_str());
+        return;
+    }
+
+    entry.max_age = DefaultMaxAge;
+    if (cache_control.find("no-cache") != std::string::npos)
+    {
+        entry.max_age = 0;
+    }
+    else if (size_t p{ cache_control.find("max-age=") }; p != std::string::npos)
+    {
+        try
+        {
+            entry.max_age = std::stoll(cache_control.substr(p + 8));
+        }
+        catch (const std::logic_error&)
+        {
+        }
+    }
+
+    entry.fetched = g_get_real_time() / G_USEC_PER_SEC;
+
+    std::ostringstream ss;
+    ss << "# " PACKAGE " response cache " CACHE_VERSION << '\n'
+       << url << '\n'
+       << account << '\n'
+       << entry.fetched << '\n'
+       << entry.max_age << '\n'
+       << entry.etag << '\n'
+       << entry.last_modified << '\n'
+       << entry.data;
+
+    if (!Glib::file_test(CacheDir, Glib::FILE_TEST_EXISTS))
+        g_mkdir_with_parents(CacheDir.c_str(), 0700);
+
+    GStatBuf st;
+    const gint64 old_size{ g_stat(path.c_str(), &st) == 0 ? st.st_size : 0 };
+    const std::string contents{ ss.str() };
+
+    try
+    {
+        Glib::file_set_contents(path, contents);
+    }
+    catch (const Glib::FileError& ex)
+    {
+        std::cerr << "Glib::file_set_contents: " << ex.what() << std::endl;
+        return;
+    }
+
+    if (m_Bytes >= 0)
+        m_Bytes += static_cast<gint64>(contents.size()) - old_size;
+
+    if (m_Bytes < 0 || m_Bytes > MaxBytes)
+        prune();
+}
+
+std::string ResponseCache::get_path(const std::string& url, const std::string& account) const
+{
+    return Glib::build_filename(
+        CacheDir,
+        Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5, account + '\n' + url));
+}
+
+void ResponseCache::prune()
+{
+    struct File
+    {
+        std::string path;
+        gint64 mtime, size;
+    };
+    std::vector<File> files;
+
+    m_Bytes = 0;
+
+    try
+    {
+        Glib::Dir dir{ CacheDir };
+        for (const std::string& name : dir)
+        {
+            GStatBuf st;
+            std::string path{ Glib::build_filename(CacheDir, name) };
+
+            if (g_stat(path.c_str(), &st) == 0)
+            {
+                files.push_back({ std::move(path), st.st_mtime, st.st_size });
+                m_Bytes += st.st_size;
+            }
+        }
+    }
+    catch (const Glib::FileError&)
+    {
+        return;
+    }
+
+    if (m_Bytes <= MaxBytes)
+        return;
+
+    std::sort(files.begin(), files.end(), [](const File& a, const File& b) {
+        return a.mtime < b.mtime;
+    });
+
+    // Leave some room so this doesn't run again after every store
+    for (const File& f : files)
+    {
+        if (m_Bytes <= MaxBytes * 3 / 4)
+            break;
+
+        if (g_unlink(f.path.c_str()) == 0)
+            m_Bytes -= f.size;
+    }
+}
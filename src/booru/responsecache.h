@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glibmm.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace AhoViewer::Booru
+{
+    // On disk cache of API responses keyed by their URL, stored in the user's cache directory
+    // so searches that were already done, even before a restart, don't need to download the
+    // whole response again.
+    // Responses depend on who is logged in (rating filters, private posts) so they are also
+    // keyed by the account they were fetched with, empty when not logged in.
+    class ResponseCache
+    {
+    public:
+        struct Entry
+        {
+            std::string etag, last_modified, data;
+            // Unix time of when the response was downloaded or last revalidated
+            gint64 fetched{ 0 }, max_age{ 0 };
+
+            bool is_fresh() const { return g_get_real_time() / G_USEC_PER_SEC < fetched + max_age; }
+            // Headers that turn the next request into a conditional one
+            std::vector<std::string> get_validators() const;
+        };
+
+        static ResponseCache& get_instance()
+        {
+            static ResponseCache i;
+            return i;
+        }
+
+        bool lookup(const std::string& url, const std::string& account, Entry& entry);
+        // cache_control is the response's Cache-Control header, the entry is not stored if
+        // it contains no-store
+        void store(const std::string& url,
+                   const std::string& account,
+                   Entry entry,
+                   const std::string& cache_control);
+
+    private:
+        ResponseCache() = default;
+
+        std::string get_path(const std::string& url, const std::string& account) const;
+        // Removes the least recently used entries until the cache is below MaxBytes
+        void prune();
+
+        static const std::string CacheDir;
+        static constexpr gint64 MaxBytes{ 32 * 1024 * 1024 };
+        // Used when the server doesn't send a max-age
+        static constexpr gint64 DefaultMaxAge{ 2 * 60 };
+
+        // -1 until the cache directory has been scanned
+        gint64 m_Bytes{ -1 };
+        std::mutex m_Mutex;
+    };
+}
@@ -14,6 +14,7 @@ extern "C"
 #include "entities.h"
 }
 #include "image.h"
+#include "imagefetcher.h"
 #include "settings.h"
 
 #include <chrono>
@@ -380,7 +381,8 @@ Site::Site(std::string name,
             {
                 try
                 {
-                    json j = json::parse(curler.get_data());
+                    const unsigned char* raw{ curler.get_data() };
+                    json j = json::parse(raw, raw + curler.get_data_size());
 
                     std::string data{ j["data"].get<std::string>() }, line;
                     std::istringstream iss{ data };
@@ -433,6 +435,7 @@ Site::~Site()
         m_IconCurlerThread.join();
 
     cleanup_cookie();
+    m_ImageFetcher.reset();
     curl_share_cleanup(m_ShareHandle);
 }
 
@@ -448,6 +451,14 @@ std::string Site::get_posts_url(const std::string& tags, size_t page)
                                   tags);
 }
 
+std::shared_ptr<ImageFetcher> Site::get_image_fetcher()
+{
+    if (!m_ImageFetcher)
+        m_ImageFetcher = std::make_shared<ImageFetcher>(get_multiplexing(), m_MaxConnections);
+
+    return m_ImageFetcher;
+}
+
 void Site::add_tags(const std::vector<Tag>& tags)
 {
     auto& favorite_tags{ Settings.get_favorite_tags() };
@@ -785,28 +796,30 @@ Site::parse_post_data(unsigned char* data, const size_t size)
                 for (const xml::Node& post : posts_xml.get_children())
                 {
                     std::vector<Tag> tags;
-                    std::string id, image_url, thumb_url, post_url, notes_url, date, source, rating,
-                        score;
+                    std::string id, image_url, sample_url, thumb_url, post_url, notes_url, date,
+                        source, rating, score;
 
                     if (m_Type == Type::DANBOORU_V2)
                     {
-                        id        = post.get_value("id");
-                        image_url = post.get_value(m_UseSamples ? "large-file-url" : "file-url");
-                        thumb_url = post.get_value("preview-file-url");
-                        date      = post.get_value("created-at");
-                        source    = post.get_value("source");
-                        rating    = post.get_value("rating");
-                        score     = post.get_value("score");
+                        id         = post.get_value("id");
+                        image_url  = post.get_value("file-url");
+                        sample_url = post.get_value("large-file-url");
+                        thumb_url  = post.get_value("preview-file-url");
+                        date       = post.get_value("created-at");
+                        source     = post.get_value("source");
+                        rating     = post.get_value("rating");
+                        score      = post.get_value("score");
                     }
                     else
                     {
-                        id        = post.get_attribute("id");
-                        image_url = post.get_attribute(m_UseSamples ? "sample_url" : "file_url");
-                        thumb_url = post.get_attribute("preview_url");
-                        date      = post.get_attribute("created_at");
-                        source    = post.get_attribute("source");
-                        rating    = post.get_attribute("rating");
-                        score     = post.get_attribute("score");
+                        id         = post.get_attribute("id");
+                        image_url  = post.get_attribute("file_url");
+                        sample_url = post.get_attribute("sample_url");
+                        thumb_url  = post.get_attribute("preview_url");
+                        date       = post.get_attribute("created_at");
+                        source     = post.get_attribute("source");
+                        rating     = post.get_attribute("rating");
+                        score      = post.get_attribute("score");
                     }
 
                     if (m_Type == Type::DANBOORU_V2)
@@ -930,7 +943,12 @@ Site::parse_post_data(unsigned char* data, const size_t size)
                         format_date_time(t), source, get_rating_string(rating), score
                     };
 
-                    posts.emplace_back(image_url, thumb_url, post_url, notes_url, tags, post_info);
+                    // Posts that are small enough are not sampled, the sample url is the same
+                    if (sample_url == image_url)
+                        sample_url.clear();
+
+                    posts.emplace_back(
+                        image_url, sample_url, thumb_url, post_url, notes_url, tags, post_info);
                 }
             }
         }
@@ -948,7 +966,7 @@ Site::parse_post_data(unsigned char* data, const size_t size)
         error       = pe;
 
         for (const auto& post : posts)
-            add_tags(std::get<4>(post));
+            add_tags(std::get<5>(post));
     }
 #endif // HAVE_LIBPEAS
 
@@ -1022,6 +1040,25 @@ std::vector<Note> Site::parse_note_data(unsigned char* data, const size_t size)
     return notes;
 }
 
+bool Site::get_cached_notes(const std::string& url, std::vector<Note>& notes) const
+{
+    auto it{ m_NotesCache.find(url) };
+    if (it == m_NotesCache.end())
+        return false;
+
+    notes = it->second;
+    return true;
+}
+
+void Site::cache_notes(const std::string& url, std::vector<Note> notes)
+{
+    // Notes are tiny, so just start over instead of tracking which were used last
+    if (m_NotesCache.size() >= MaxCachedNotes)
+        m_NotesCache.clear();
+
+    m_NotesCache[url] = std::move(notes);
+}
+
 // Used to get tag types for gelbooru.com
 std::unordered_map<std::string, Tag::Type> Site::get_posts_tags(const xml::Document& posts) const
 {
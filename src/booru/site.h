@@ -17,6 +17,7 @@
 
 namespace AhoViewer::Booru
 {
+    class ImageFetcher;
     class Site
     {
     public:
@@ -75,7 +76,12 @@ namespace AhoViewer::Booru
 
         int get_max_connections() const { return m_MaxConnections; }
         CURLSH* get_share_handle() const { return m_ShareHandle; }
+        // Shared by every tab browsing this site so they can reuse the same connections,
+        // created the first time it's needed. Main thread only
+        std::shared_ptr<ImageFetcher> get_image_fetcher();
 
+        // Lets images be downloaded as samples when the original would take too long, plugins
+        // still get the choice passed to parse_post_data
         bool use_samples() const { return m_UseSamples; }
         void set_use_samples(const bool s) { m_UseSamples = s; }
 
@@ -87,6 +93,9 @@ namespace AhoViewer::Booru
         parse_post_data(unsigned char* data, const size_t size);
 
         std::vector<Note> parse_note_data(unsigned char* data, const size_t size) const;
+        // Notes are cached by their URL, which is unique to each post. Main thread only
+        bool get_cached_notes(const std::string& url, std::vector<Note>& notes) const;
+        void cache_notes(const std::string& url, std::vector<Note> notes);
 
         Glib::Dispatcher& signal_icon_downloaded() { return m_SignalIconDownloaded; }
 #ifdef HAVE_LIBSECRET
@@ -125,10 +134,14 @@ namespace AhoViewer::Booru
         std::unordered_map<std::string, Tag::Type> m_MoebooruTags;
         std::mutex m_TagMutex;
 
+        static constexpr size_t MaxCachedNotes{ 2048 };
+        std::unordered_map<std::string, std::vector<Note>> m_NotesCache;
+
         int m_MaxConnections{ 0 };
         CURLSH* m_ShareHandle;
         std::map<curl_lock_data, std::mutex> m_MutexMap;
         Curler m_Curler;
+        std::shared_ptr<ImageFetcher> m_ImageFetcher;
 #ifdef HAVE_LIBPEAS
         std::shared_ptr<Plugin::SitePlugin> m_Plugin{ nullptr };
 #endif // HAVE_LIBPEAS
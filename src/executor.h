@@ -0,0 +1,478 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace AhoViewer
+{
+    // Runs tasks on a fixed set of worker threads.
+    // The whole program shares one executor through get_instance, each user of it holds a
+    // Client which limits how many of the workers it can occupy at once.
+    // Every worker has its own queue for each priority, pushed tasks are spread between
+    // them and idle workers steal from the others. Higher priority tasks are always
+    // taken before lower priority ones, whichever worker they were queued on.
+    class Executor
+    {
+    public:
+        // Lanes in the order they are run
+        enum class Priority
+        {
+            VISIBLE,
+            PREFETCH,
+            BACKGROUND,
+        };
+        static constexpr size_t NumPriorities{ 3 };
+
+        // Tasks pushed with a token are skipped if the token was cancelled before they
+        // start, long running tasks can also check it themselves
+        class CancelToken
+        {
+        public:
+            CancelToken() : m_Cancelled{ std::make_shared<std::atomic<bool>>(false) } { }
+
+            void cancel() { *m_Cancelled = true; }
+            bool is_cancelled() const { return *m_Cancelled; }
+
+        private:
+            friend class Executor;
+            std::shared_ptr<std::atomic<bool>> m_Cancelled;
+        };
+
+        // Move only callable that keeps small functors (most lambdas) inside of itself
+        // instead of allocating them
+        class Task
+        {
+        public:
+            Task() = default;
+            template<typename F,
+                     typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+            Task(F&& f)
+            {
+                using Fn = std::decay_t<F>;
+                if constexpr (sizeof(Fn) <= BufferSize &&
+                              alignof(Fn) <= alignof(std::max_align_t) &&
+                              std::is_nothrow_move_constructible_v<Fn>)
+                {
+                    new (&m_Buffer) Fn(std::forward<F>(f));
+                    m_Ops = &InlineOps<Fn>;
+                }
+                else
+                {
+                    new (&m_Buffer) Fn*(new Fn(std::forward<F>(f)));
+                    m_Ops = &HeapOps<Fn>;
+                }
+            }
+            Task(Task&& t) noexcept { *this = std::move(t); }
+            Task& operator=(Task&& t) noexcept
+            {
+                if (this != &t)
+                {
+                    reset();
+                    if (t.m_Ops)
+                    {
+                        t.m_Ops->move(&m_Buffer, &t.m_Buffer);
+                        m_Ops   = t.m_Ops;
+                        t.m_Ops = nullptr;
+                    }
+                }
+                return *this;
+            }
+            ~Task() { reset(); }
+
+            void operator()() { m_Ops->call(&m_Buffer); }
+            explicit operator bool() const { return m_Ops; }
+
+        private:
+            struct Ops
+            {
+                void (*call)(void*);
+                void (*move)(void* dst, void* src);
+                void (*destroy)(void*);
+            };
+
+            template<typename Fn>
+            static constexpr Ops InlineOps{
+                [](void* b) { (*static_cast<Fn*>(b))(); },
+                [](void* dst, void* src) {
+                    new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+                    static_cast<Fn*>(src)->~Fn();
+                },
+                [](void* b) { static_cast<Fn*>(b)->~Fn(); },
+            };
+            template<typename Fn>
+            static constexpr Ops HeapOps{
+                [](void* b) { (**static_cast<Fn**>(b))(); },
+                [](void* dst, void* src) { new (dst) Fn*(*static_cast<Fn**>(src)); },
+                [](void* b) { delete *static_cast<Fn**>(b); },
+            };
+
+            void reset()
+            {
+                if (m_Ops)
+                    m_Ops->destroy(&m_Buffer);
+                m_Ops = nullptr;
+            }
+
+            static constexpr size_t BufferSize{ 48 };
+
+            alignas(std::max_align_t) unsigned char m_Buffer[BufferSize];
+            const Ops* m_Ops{ nullptr };
+        };
+
+        // Queues tasks on an executor without ever having more than quota of them queued or
+        // running there, the rest wait in the client's own backlog.
+        // Destroying the client drops its backlog and waits for its running tasks.
+        class Client
+        {
+        public:
+            // A quota of 0 means the size of the executor
+            Client(const size_t quota = 0, Executor& e = get_instance())
+                : m_Executor{ e },
+                  m_State{ std::make_shared<State>() }
+            {
+                set_quota(quota);
+            }
+            ~Client() { kill(); }
+
+            void set_quota(const size_t quota)
+            {
+                std::scoped_lock lock{ m_State->mutex };
+                m_State->quota = quota ? quota : m_Executor.size();
+                submit(m_Executor, m_State);
+            }
+
+            // Whether there are any queued or running tasks
+            bool active() const { return m_State->pending != 0; }
+
+            template<typename F>
+            void push(F&& f, const Priority p = Priority::VISIBLE)
+            {
+                std::scoped_lock lock{ m_State->mutex };
+                ++m_State->pending;
+                m_State->backlog[static_cast<size_t>(p)].emplace_back(std::forward<F>(f));
+                submit(m_Executor, m_State);
+            }
+
+            // Removes remaining tasks without waiting for the running ones
+            void cancel()
+            {
+                std::scoped_lock lock{ m_State->mutex };
+                for (auto& lane : m_State->backlog)
+                {
+                    m_State->pending -= lane.size();
+                    lane.clear();
+                }
+
+                if (m_State->pending == 0)
+                    m_State->cond.notify_all();
+            }
+
+            // Removes remaining tasks and waits for the running ones to finish
+            void kill()
+            {
+                cancel();
+                wait();
+            }
+
+            // Waits for remaining tasks to complete
+            void wait()
+            {
+                std::unique_lock<std::mutex> lock(m_State->mutex);
+                m_State->cond.wait(lock, [&]() { return m_State->pending == 0; });
+            }
+
+        private:
+            Client(const Client&) = delete;
+            Client& operator=(const Client&) = delete;
+
+            // Shared with the tasks queued on the executor so they can outlive the client
+            struct State
+            {
+                std::array<std::deque<Task>, NumPriorities> backlog;
+                // Slots are queued on the executor and take the most important task from
+                // the backlog once a worker gets to them, counted by the priority they
+                // were queued at
+                std::array<size_t, NumPriorities> slots{};
+                size_t quota{ 0 }, running{ 0 };
+                std::atomic<size_t> pending{ 0 };
+
+                std::mutex mutex;
+                std::condition_variable cond;
+            };
+
+            // Must be called with s->mutex locked
+            static void submit(Executor& e, const std::shared_ptr<State>& s)
+            {
+                size_t backlog{ 0 }, slots{ 0 }, p{ NumPriorities };
+                bool covered{ false };
+                for (size_t i = NumPriorities; i-- > 0;)
+                {
+                    if (!s->backlog[i].empty())
+                        p = i;
+                    backlog += s->backlog[i].size();
+                    slots += s->slots[i];
+                }
+
+                if (backlog == 0)
+                    return;
+
+                for (size_t i = 0; i <= p; ++i)
+                    covered = covered || s->slots[i] != 0;
+
+                for (; slots + s->running < s->quota && slots < backlog; ++slots, covered = true)
+                    queue_slot(e, s, p);
+
+                // The most important task would otherwise wait for a slot queued at a lower
+                // priority to reach a worker, run decides which slot gets to run it
+                if (!covered && s->running < s->quota)
+                    queue_slot(e, s, p);
+            }
+
+            static void queue_slot(Executor& e, const std::shared_ptr<State>& s, const size_t p)
+            {
+                ++s->slots[p];
+                e.push([&e, s, p]() { run(e, s, p); }, static_cast<Priority>(p));
+            }
+
+            static void run(Executor& e, const std::shared_ptr<State>& s, const size_t p)
+            {
+                Task t;
+                {
+                    std::scoped_lock lock{ s->mutex };
+                    --s->slots[p];
+
+                    // Another slot got here first and took the last free spot in the quota,
+                    // its task will queue a new slot once it finishes
+                    if (s->running >= s->quota)
+                        return;
+
+                    for (auto& lane : s->backlog)
+                    {
+                        if (!lane.empty())
+                        {
+                            t = std::move(lane.front());
+                            lane.pop_front();
+                            ++s->running;
+                            break;
+                        }
+                    }
+                }
+
+                // The backlog was cancelled or emptied by another slot after this was queued
+                if (!t)
+                    return;
+
+                t();
+                t = Task();
+
+                std::scoped_lock lock{ s->mutex };
+                --s->running;
+                submit(e, s);
+
+                if (--s->pending == 0)
+                    s->cond.notify_all();
+            }
+
+            Executor& m_Executor;
+            std::shared_ptr<State> m_State;
+        };
+
+        static Executor& get_instance()
+        {
+            static Executor i;
+            return i;
+        }
+
+        // One thread is left for the main thread, hardware_concurrency is 0 when it's unknown.
+        // There is always at least one worker
+        Executor(size_t n_threads = std::max(std::thread::hardware_concurrency(), 1u) - 1)
+            : m_Workers(std::max(n_threads, size_t{ 1 }))
+        {
+            for (size_t i = 0; i < m_Workers.size(); ++i)
+                m_Workers[i].thread = std::thread(&Executor::run, this, i);
+        }
+        // Queued tasks are dropped, running tasks are waited for
+        ~Executor()
+        {
+            kill();
+
+            {
+                std::scoped_lock lock{ m_SleepMutex };
+                m_Shutdown = true;
+            }
+            m_SleepCond.notify_all();
+
+            for (Worker& w : m_Workers)
+                w.thread.join();
+        }
+
+        size_t size() const { return m_Workers.size(); }
+
+        // Whether there are any queued or running tasks
+        bool active() const { return m_Pending != 0; }
+
+        template<typename F>
+        void push(F&& f, const Priority p = Priority::VISIBLE)
+        {
+            push(std::forward<F>(f), p, get_token());
+        }
+        template<typename F>
+        void push(F&& f, const Priority p, CancelToken token)
+        {
+            Worker& w{ m_Workers[m_NextWorker++ % m_Workers.size()] };
+
+            ++m_Pending;
+            {
+                std::scoped_lock lock{ w.mutex };
+                w.lanes[static_cast<size_t>(p)].push_back(
+                    { Task{ std::forward<F>(f) }, std::move(token.m_Cancelled) });
+            }
+            ++m_Queued;
+
+            // Taking the lock makes sure a worker that is about to sleep sees m_Queued
+            {
+                std::scoped_lock lock{ m_SleepMutex };
+            }
+            m_SleepCond.notify_one();
+        }
+
+        // The token given to tasks pushed without one, replaced by kill
+        CancelToken get_token() const
+        {
+            std::scoped_lock lock{ m_TokenMutex };
+            return m_Token;
+        }
+
+        // Removes remaining tasks and waits for the running ones to finish
+        void kill()
+        {
+            {
+                std::scoped_lock lock{ m_TokenMutex };
+                m_Token.cancel();
+                m_Token = CancelToken();
+            }
+
+            for (Worker& w : m_Workers)
+            {
+                std::scoped_lock lock{ w.mutex };
+                for (auto& lane : w.lanes)
+                {
+                    m_Queued -= lane.size();
+                    m_Pending -= lane.size();
+                    lane.clear();
+                }
+            }
+
+            wait();
+        }
+
+        // Waits for remaining tasks to complete
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(m_IdleMutex);
+            m_IdleCond.wait(lock, [&]() { return m_Pending == 0; });
+        }
+
+    private:
+        Executor(const Executor&) = delete;
+        Executor& operator=(const Executor&) = delete;
+
+        struct QueuedTask
+        {
+            Task task;
+            std::shared_ptr<std::atomic<bool>> cancelled;
+        };
+
+        struct Worker
+        {
+            std::array<std::deque<QueuedTask>, NumPriorities> lanes;
+            std::mutex mutex;
+            std::thread thread;
+        };
+
+        // Workers take from the front of their own lanes and steal from the back of others
+        bool take(const size_t i, QueuedTask& t)
+        {
+            for (size_t p = 0; p < NumPriorities; ++p)
+            {
+                for (size_t n = 0; n < m_Workers.size(); ++n)
+                {
+                    Worker& w{ m_Workers[(i + n) % m_Workers.size()] };
+                    std::scoped_lock lock{ w.mutex };
+                    auto& lane{ w.lanes[p] };
+
+                    if (lane.empty())
+                        continue;
+
+                    if (n == 0)
+                    {
+                        t = std::move(lane.front());
+                        lane.pop_front();
+                    }
+                    else
+                    {
+                        t = std::move(lane.back());
+                        lane.pop_back();
+                    }
+
+                    --m_Queued;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void run(const size_t i)
+        {
+            while (true)
+            {
+                QueuedTask t;
+                if (take(i, t))
+                {
+                    if (!*t.cancelled)
+                        t.task();
+
+                    // Release anything the task captured before anyone waiting is woken up
+                    t.task = Task();
+                    t.cancelled.reset();
+
+                    if (--m_Pending == 0)
+                    {
+                        std::scoped_lock lock{ m_IdleMutex };
+                        m_IdleCond.notify_all();
+                    }
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(m_SleepMutex);
+                m_SleepCond.wait(lock, [&]() { return m_Queued != 0 || m_Shutdown; });
+
+                if (m_Shutdown && m_Queued == 0)
+                    return;
+            }
+        }
+
+        std::vector<Worker> m_Workers;
+        // Replaced by kill while other threads may be pushing
+        CancelToken m_Token;
+        mutable std::mutex m_TokenMutex;
+
+        std::atomic<size_t> m_NextWorker{ 0 }, m_Queued{ 0 }, m_Pending{ 0 };
+        bool m_Shutdown{ false };
+
+        std::mutex m_SleepMutex, m_IdleMutex;
+        std::condition_variable m_SleepCond, m_IdleCond;
+    };
+}
@@ -1,6 +1,7 @@
 #include "image.h"
 using namespace AhoViewer;
 
+#include "naturalsort.h"
 #include "settings.h"
 
 #include <cctype>
@@ -87,7 +88,10 @@ static unsigned char* _def_bitmap_get_buffer(void* bitmap)
     return static_cast<unsigned char*>(bitmap);
 }
 
-Image::Image(std::string path) : m_IsWebM{ Image::is_webm(path) }, m_Path{ std::move(path) }
+Image::Image(std::string path)
+    : m_IsWebM{ Image::is_webm(path) },
+      m_Path{ std::move(path) },
+      m_SortKey{ NaturalSort::make_key(m_Path) }
 {
     m_BitmapCallbacks.bitmap_create      = _def_bitmap_create;
     m_BitmapCallbacks.bitmap_destroy     = _def_bitmap_destroy;
@@ -181,10 +185,15 @@ const Glib::RefPtr<Gdk::Pixbuf>& Image::get_thumbnail(Glib::RefPtr<Gio::Cancella
 }
 
 void Image::load_pixbuf(Glib::RefPtr<Gio::Cancellable> c)
+{
+    load_pixbuf_from_file(m_Path, c);
+}
+
+void Image::load_pixbuf_from_file(const std::string& path, Glib::RefPtr<Gio::Cancellable> c)
 {
     if (!m_Pixbuf && !m_IsWebM)
     {
-        Glib::RefPtr<Gio::File> file{ Gio::File::create_for_path(m_Path) };
+        Glib::RefPtr<Gio::File> file{ Gio::File::create_for_path(path) };
 
         std::array<unsigned char, 4> data;
         file->read()->read(&data, 4);
@@ -214,7 +223,7 @@ void Image::load_pixbuf(Glib::RefPtr<Gio::Cancellable> c)
             }
             catch (const Gdk::PixbufError& e)
             {
-                std::cerr << "Failed to load pixbuf from file '" << m_Path << "'" << std::endl
+                std::cerr << "Failed to load pixbuf from file '" << path << "'" << std::endl
                           << e.what() << std::endl;
             }
 
@@ -232,6 +241,55 @@ void Image::load_pixbuf(Glib::RefPtr<Gio::Cancellable> c)
     }
 }
 
+void Image::load_pixbuf_from_data(const unsigned char* data,
+                                  const size_t size,
+                                  Glib::RefPtr<Gio::Cancellable> c)
+{
+    if (m_Pixbuf || m_IsWebM)
+        return;
+
+    if (size >= 4 && is_gif(data))
+    {
+        m_GIFanim = new gif_animation;
+        gif_create(m_GIFanim, &m_BitmapCallbacks);
+
+        m_GIFdataSize = size;
+        m_GIFdata     = new unsigned char[m_GIFdataSize];
+        memcpy(m_GIFdata, data, m_GIFdataSize);
+
+        load_gif();
+    }
+    else
+    {
+        // The stream does not copy or free data, it only needs to outlive the decode
+        auto stream{ Gio::MemoryInputStream::create() };
+        stream->add_data(data, size);
+
+        Glib::RefPtr<Gdk::Pixbuf> p{ nullptr };
+        try
+        {
+            p = Gdk::Pixbuf::create_from_stream(stream, c);
+        }
+        catch (const Glib::Error& e)
+        {
+            if (!c->is_cancelled())
+                std::cerr << "Failed to load pixbuf from '" << get_filename() << "'" << std::endl
+                          << e.what() << std::endl;
+        }
+
+        if (!p || c->is_cancelled())
+            return;
+
+        {
+            std::scoped_lock lock{ m_Mutex };
+            m_Pixbuf = p;
+        }
+    }
+
+    m_Loading = false;
+    m_SignalPixbufChanged();
+}
+
 // Call this once m_GIFdata has been set
 void Image::load_gif()
 {
@@ -275,6 +333,22 @@ void Image::reset_pixbuf()
     }
 }
 
+void Image::set_info(const ImageInfo& info)
+{
+    std::scoped_lock lock{ m_InfoMutex };
+    m_Info    = info;
+    m_HasInfo = true;
+}
+
+bool Image::get_info(ImageInfo& info) const
+{
+    std::scoped_lock lock{ m_InfoMutex };
+    if (m_HasInfo)
+        info = m_Info;
+
+    return m_HasInfo;
+}
+
 bool Image::gif_advance_frame()
 {
     // Handle frame advacing and looping.
@@ -399,6 +473,30 @@ Glib::RefPtr<Gdk::Pixbuf> Image::create_pixbuf_at_size(const std::string& path,
     return pixbuf;
 }
 
+Glib::RefPtr<Gdk::Pixbuf> Image::create_pixbuf_at_size(const unsigned char* data,
+                                                       const size_t size,
+                                                       const int w,
+                                                       const int h,
+                                                       Glib::RefPtr<Gio::Cancellable> c) const
+{
+    auto stream{ Gio::MemoryInputStream::create() };
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+
+    stream->add_data(data, size);
+
+    try
+    {
+        pixbuf = Gdk::Pixbuf::create_from_stream_at_scale(stream, w, h, true, c);
+    }
+    catch (...)
+    {
+        if (!c->is_cancelled())
+            std::cerr << "Error while loading thumbnail for " << get_filename() << std::endl;
+    }
+
+    return pixbuf;
+}
+
 Glib::RefPtr<Gdk::Pixbuf>
 Image::scale_pixbuf(Glib::RefPtr<Gdk::Pixbuf>& pixbuf, const int w, const int h) const
 {
@@ -9,6 +9,8 @@ extern "C"
 }
 
 #include "config.h"
+#include "metadataindex.h"
+#include "uidispatcher.h"
 #include "util.h"
 
 #include <atomic>
@@ -32,6 +34,8 @@ namespace AhoViewer
         static const Glib::RefPtr<Gdk::Pixbuf>& get_missing_pixbuf();
 
         const std::string get_path() const { return m_Path; }
+        // Collation key of the path used by NaturalSort
+        const std::string& get_sort_key() const { return m_SortKey; }
         bool is_webm() const { return m_IsWebM; }
         bool is_animated_gif() const { return m_GIFanim && m_GIFanim->frame_count > 1; }
 
@@ -46,16 +50,24 @@ namespace AhoViewer
 
         const std::vector<Note>& get_notes() const { return m_Notes; }
 
+        // Header information from the directory's MetadataIndex, get_info returns false
+        // until the image has been indexed
+        void set_info(const ImageInfo& info);
+        bool get_info(ImageInfo& info) const;
+
         virtual void load_pixbuf(Glib::RefPtr<Gio::Cancellable> c);
         virtual void reset_pixbuf();
+        // Called when the image is zoomed, booru images that are showing a smaller sample
+        // replace it with the original
+        virtual void load_full_size() { }
 
         bool gif_advance_frame();
         bool get_gif_finished_looping() const;
         unsigned int get_gif_frame_delay() const;
         void reset_gif_animation();
 
-        Glib::Dispatcher& signal_pixbuf_changed() { return m_SignalPixbufChanged; }
-        Glib::Dispatcher& signal_notes_changed() { return m_SignalNotesChanged; }
+        UIDispatcher& signal_pixbuf_changed() { return m_SignalPixbufChanged; }
+        UIDispatcher& signal_notes_changed() { return m_SignalNotesChanged; }
 
         static const size_t ThumbnailSize{ 100 };
 
@@ -71,9 +83,22 @@ namespace AhoViewer
                                                         const int h,
                                                         Glib::RefPtr<Gio::Cancellable> c) const;
 
+        // Same as load_pixbuf but loads the file at path instead of m_Path
+        void load_pixbuf_from_file(const std::string& path, Glib::RefPtr<Gio::Cancellable> c);
+        // Same as load_pixbuf and create_pixbuf_at_size but decode the image from an in
+        // memory copy of the file, used for images that never need to be written to disk
+        void load_pixbuf_from_data(const unsigned char* data,
+                                   const size_t size,
+                                   Glib::RefPtr<Gio::Cancellable> c);
+        Glib::RefPtr<Gdk::Pixbuf> create_pixbuf_at_size(const unsigned char* data,
+                                                        const size_t size,
+                                                        const int w,
+                                                        const int h,
+                                                        Glib::RefPtr<Gio::Cancellable> c) const;
+
         bool m_IsWebM;
         std::atomic<bool> m_Loading{ true };
-        std::string m_Path, m_ThumbnailPath;
+        std::string m_Path, m_ThumbnailPath, m_SortKey;
 
         Glib::RefPtr<Gdk::Pixbuf> m_ThumbnailPixbuf;
         Glib::RefPtr<Gdk::Pixbuf> m_Pixbuf;
@@ -87,9 +112,13 @@ namespace AhoViewer
         std::vector<Note> m_Notes;
 
         std::mutex m_Mutex;
-        Glib::Dispatcher m_SignalPixbufChanged, m_SignalNotesChanged;
+        UIDispatcher m_SignalPixbufChanged, m_SignalNotesChanged;
 
     private:
+        ImageInfo m_Info;
+        bool m_HasInfo{ false };
+        mutable std::mutex m_InfoMutex;
+
         Glib::RefPtr<Gdk::Pixbuf>
         scale_pixbuf(Glib::RefPtr<Gdk::Pixbuf>& pixbuf, const int w, const int h) const;
 
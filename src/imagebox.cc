@@ -253,6 +253,10 @@ void ImageBox::set_image(const std::shared_ptr<Image>& image)
         m_ImageConn = m_Image->signal_pixbuf_changed().connect(
             sigc::bind(sigc::mem_fun(*this, &ImageBox::queue_draw_image), false));
 
+        // Manual zoom shows the image's real size, which a sample doesn't have
+        if (m_ZoomMode == ZoomMode::MANUAL)
+            m_Image->load_full_size();
+
         // Maybe the notes havent been downloaded yet
         if (m_Image->get_notes().empty())
             m_NotesConn = m_Image->signal_notes_changed().connect(
@@ -335,6 +339,10 @@ void ImageBox::set_zoom_mode(const ZoomMode mode)
     {
         Settings.set_zoom_mode(mode);
         m_ZoomMode = mode;
+
+        if (m_ZoomMode == ZoomMode::MANUAL && m_Image)
+            m_Image->load_full_size();
+
         queue_draw_image(true);
     }
 }
@@ -894,6 +902,10 @@ void ImageBox::zoom(const std::uint32_t percent)
 
     m_ZoomScroll  = m_ZoomPercent != percent;
     m_ZoomPercent = percent;
+
+    if (m_Image)
+        m_Image->load_full_size();
+
     queue_draw_image();
 }
 
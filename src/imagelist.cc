@@ -5,6 +5,9 @@ using namespace AhoViewer;
 #include "naturalsort.h"
 #include "settings.h"
 
+#include <chrono>
+#include <iostream>
+#include <limits>
 #include <numeric>
 #include <thread>
 
@@ -12,7 +15,9 @@ ImageList::ImageList(Widget* const w)
     : m_Widget{ w },
       m_ScrollPos{ -1, -1, ZoomMode::AUTO_FIT },
       m_ThumbnailCancel{ Gio::Cancellable::create() },
-      m_CacheCancel{ Gio::Cancellable::create() }
+      m_CacheCancel{ Gio::Cancellable::create() },
+      m_ScanCancel{ Gio::Cancellable::create() },
+      m_MetadataCancel{ Gio::Cancellable::create() }
 {
     // Sorts indices based on how close they are to m_Index
     m_IndexSort = [=](size_t a, size_t b) {
@@ -26,21 +31,8 @@ ImageList::ImageList(Widget* const w)
 
     m_ThumbnailLoadedConn =
         m_SignalThumbnailLoaded.connect(sigc::mem_fun(*this, &ImageList::on_thumbnail_loaded));
-
-    m_CacheThread = std::thread([&]() {
-        while (!m_CacheStop)
-        {
-            {
-                std::unique_lock<std::mutex> lock(m_CacheMutex);
-                m_CacheCond.wait(
-                    lock, [&]() { return !m_CacheQueue.empty() || m_CacheCancel->is_cancelled(); });
-            }
-
-            std::shared_ptr<Image> img = nullptr;
-            while (!m_CacheCancel->is_cancelled() && m_CacheQueue.pop(img))
-                img->load_pixbuf(m_CacheCancel);
-        }
-    });
+    m_SignalScanBatch.connect(sigc::mem_fun(*this, &ImageList::on_scan_batch));
+    m_SignalArchivePrefetched.connect(sigc::mem_fun(*this, &ImageList::on_archive_prefetched));
 }
 
 ImageList::~ImageList()
@@ -49,10 +41,13 @@ ImageList::~ImageList()
 
     reset();
 
-    m_CacheStop = true;
+    m_MonitorStop = true;
+    m_MonitorQueue.wake();
+    if (m_MonitorThread.joinable())
+        m_MonitorThread.join();
+
     m_CacheCancel->cancel();
-    m_CacheCond.notify_one();
-    m_CacheThread.join();
+    m_CacheExecutor.kill();
 }
 
 void ImageList::clear()
@@ -63,12 +58,21 @@ void ImageList::clear()
 
 // Creates a local image list from a given file (archive/image) or direcotry.
 // The parameter index is used when reopening an archive at a given index.
+// When a single image is opened it is shown right away and the rest of the
+// directory is scanned and merged into the list in the background.
 bool ImageList::load(const std::string path, std::string& error, int index)
 {
     std::unique_ptr<Archive> archive{ nullptr };
+    std::vector<std::string> entries;
+    ImageVector images;
     std::string dir_path;
 
-    if (Glib::file_test(path, Glib::FILE_TEST_EXISTS))
+    // The next or previous archive may have already been opened in the background
+    if (take_prefetched_archive(path, archive, entries, images))
+    {
+        dir_path = archive->get_extracted_path();
+    }
+    else if (Glib::file_test(path, Glib::FILE_TEST_EXISTS))
     {
         if (Glib::file_test(path, Glib::FILE_TEST_IS_DIR))
         {
@@ -94,8 +98,20 @@ bool ImageList::load(const std::string path, std::string& error, int index)
         return false;
     }
 
-    std::vector<std::string> entries{ archive ? archive->get_entries(Archive::IMAGES)
-                                              : get_entries<Image>(dir_path) };
+    // Only a specific image was requested, no need to wait for the directory to be read
+    const bool scan{ !archive && path != dir_path };
+    // Entries of a prefetched archive have already been read and sorted
+    const bool prefetched{ !entries.empty() };
+
+    if (archive)
+    {
+        if (!prefetched)
+            entries = archive->get_entries(Archive::IMAGES);
+    }
+    else if (scan)
+        entries.push_back(path);
+    else
+        entries = get_entries<Image>(dir_path);
 
     // No valid images in this directory
     if (entries.empty())
@@ -105,6 +121,11 @@ bool ImageList::load(const std::string path, std::string& error, int index)
         return false;
     }
 
+    // Prefetched archives are always siblings of the current one
+    std::vector<std::string> archive_entries;
+    if (prefetched)
+        archive_entries = std::move(m_ArchiveEntries);
+
     reset();
 
     // Create the actual vector of images
@@ -113,43 +134,79 @@ bool ImageList::load(const std::string path, std::string& error, int index)
 
     if (archive)
     {
-        m_Archive        = std::move(archive);
-        m_ArchiveEntries = get_entries<Archive>(Glib::path_get_dirname(m_Archive->get_path()));
-        std::sort(m_ArchiveEntries.begin(), m_ArchiveEntries.end(), NaturalSort());
+        m_Archive = std::move(archive);
+
+        if (prefetched)
+        {
+            m_ArchiveEntries = std::move(archive_entries);
+        }
+        else
+        {
+            m_ArchiveEntries =
+                get_entries<Archive>(Glib::path_get_dirname(m_Archive->get_path()));
+            NaturalSort::sort(m_ArchiveEntries);
+        }
     }
     else
     {
+        m_DirPath                   = dir_path;
         Glib::RefPtr<Gio::File> dir = Gio::File::create_for_path(dir_path);
         m_FileMonitor               = dir->monitor_directory();
         m_FileMonitor->signal_changed().connect(
             sigc::mem_fun(*this, &ImageList::on_directory_changed));
     }
 
-    std::sort(entries.begin(), entries.end(), NaturalSort());
+    if (!prefetched)
+        NaturalSort::sort(entries);
 
-    if (path != dir_path && !m_Archive)
+    // Opening the previous archive starts at its last page and continues backwards
+    m_ReadDirection = index == -1 ? -1 : 1;
+
+    if (scan)
     {
-        auto iter = std::find(entries.begin(), entries.end(), path);
-        index     = iter == entries.end() ? 0 : iter - entries.begin();
+        index = 0;
     }
     else if (index == -1)
     {
         index = entries.size() - 1;
     }
 
-    for (const std::string& e : entries)
+    if (!images.empty())
     {
-        std::shared_ptr<Image> img;
-        if (m_Archive)
-            img = std::make_shared<Archive::Image>(e, *m_Archive);
-        else
-            img = std::make_shared<Image>(e);
-        m_Images.push_back(std::move(img));
+        m_Images = std::move(images);
     }
+    else
+    {
+        for (const std::string& e : entries)
+        {
+            std::shared_ptr<Image> img;
+            if (m_Archive)
+                img = std::make_shared<Archive::Image>(e, *m_Archive);
+            else
+                img = std::make_shared<Image>(e);
+            m_Images.push_back(std::move(img));
+        }
+    }
+
+    update_indices();
 
     m_SignalLoadSuccess();
     set_current(index, false, true);
-    m_ThumbnailThread = std::thread(sigc::mem_fun(*this, &ImageList::load_thumbnails));
+
+    // Thumbnails are loaded once the scan has finished, see on_scan_batch
+    if (scan)
+    {
+        m_ScanCancel->reset();
+        m_ScanThread = std::thread(
+            sigc::bind(sigc::mem_fun(*this, &ImageList::scan_directory), dir_path, path));
+    }
+    else
+    {
+        load_thumbnails();
+
+        if (!m_Archive)
+            index_metadata();
+    }
 
     return true;
 }
@@ -209,54 +266,148 @@ void ImageList::set_current(const size_t index, const bool from_widget, const bo
     if (index == m_Index && !force)
         return;
 
+    if (!force)
+        m_ReadDirection = index < m_Index ? -1 : 1;
+
     m_Index = index;
     m_SignalChanged(m_Images[m_Index]);
     update_cache();
 
-    if (m_ThreadPool.active())
+    if (m_Archive)
     {
-        cancel_thumbnail_thread();
-        m_ThumbnailThread = std::thread(sigc::mem_fun(*this, &ImageList::load_thumbnails));
+        read_ahead();
+
+        if (Settings.get_bool("AutoOpenArchive"))
+        {
+            const size_t cache_size{ static_cast<size_t>(Settings.get_int("CacheSize")) };
+
+            if (m_Index + cache_size + 1 >= m_Images.size())
+                prefetch_archive(1);
+            if (m_Index <= cache_size)
+                prefetch_archive(-1);
+        }
     }
 
+    set_thumbnail_focus(m_Index);
+
     if (!from_widget)
         m_Widget->set_selected(m_Index);
 }
 
+// Decompresses the pages the cache thread will decode next, in the direction the
+// user is reading, along with some more past the end of the cache
+void ImageList::read_ahead()
+{
+    const int count{ Settings.get_int("CacheSize") + ReadAheadCount };
+    std::vector<std::string> files;
+
+    for (int i = 0, j = m_Index; i <= count && j >= 0 && j < static_cast<int>(m_Images.size());
+         ++i, j += m_ReadDirection)
+        files.push_back(
+            std::static_pointer_cast<Archive::Image>(m_Images[j])->get_archive_file_path());
+
+    m_Archive->read_ahead(std::move(files));
+}
+
+// Queues every row that doesn't have a thumbnail yet and hasn't already been queued
 void ImageList::load_thumbnails()
 {
     m_ThumbnailCancel->reset();
+    size_t n{ 0 };
 
-    std::vector<size_t> indices(m_Images.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::sort(indices.begin(), indices.end(), m_IndexSort);
-
-    for (const size_t i : indices)
     {
-        if (m_ThumbnailCancel->is_cancelled())
-            break;
+        std::scoped_lock lock{ m_ThumbnailMutex };
+        m_ThumbnailFocus = m_Index;
+        m_ThumbnailRequested.resize(m_Images.size());
 
-        // Only load thumbnails that haven't been already
-        auto it = m_Widget->m_ListStore->get_iter(std::to_string(i));
-        if (!it || !it->get_value(m_Widget->m_Columns.pixbuf))
-            m_ThreadPool.push([&, i]() {
-                Glib::RefPtr<Gdk::Pixbuf> thumb = m_Images[i]->get_thumbnail(m_ThumbnailCancel);
-
-                if (!m_ThumbnailCancel->is_cancelled())
-                {
-                    if (!thumb)
-                        thumb = Image::get_missing_pixbuf();
+        for (size_t i = 0; i < m_Images.size(); ++i)
+        {
+            if (m_ThumbnailRequested[i])
+                continue;
 
-                    m_ThumbnailQueue.emplace(i, std::move(thumb));
-                    m_SignalThumbnailLoaded();
-                }
-            });
+            auto it = m_Widget->m_ListStore->get_iter(std::to_string(i));
+            if (!it || !it->get_value(m_Widget->m_Columns.pixbuf))
+            {
+                m_ThumbnailRequested[i] = true;
+                m_ThumbnailPending.emplace(i, m_Images[i]);
+                ++n;
+            }
+        }
     }
+
+    schedule_thumbnails(n);
+}
+
+// Each task loads whichever queued row is closest to the focus once it starts
+void ImageList::schedule_thumbnails(size_t n)
+{
+    for (; n > 0; --n)
+        m_ThumbnailExecutor.push(
+            [this]() {
+                size_t i;
+                std::shared_ptr<Image> image;
+                if (take_thumbnail(i, image))
+                    add_thumbnail(i, image->get_thumbnail(m_ThumbnailCancel));
+            },
+            Executor::Priority::PREFETCH);
+}
+
+bool ImageList::take_thumbnail(size_t& i, std::shared_ptr<Image>& image)
+{
+    std::scoped_lock lock{ m_ThumbnailMutex };
+    if (m_ThumbnailPending.empty() || m_ThumbnailCancel->is_cancelled())
+        return false;
+
+    // Closest to the focus, the one after it wins a tie like m_IndexSort
+    auto it{ m_ThumbnailPending.lower_bound(m_ThumbnailFocus) };
+    if (it == m_ThumbnailPending.end() ||
+        (it != m_ThumbnailPending.begin() &&
+         m_ThumbnailFocus - std::prev(it)->first < it->first - m_ThumbnailFocus))
+        --it;
+
+    i     = it->first;
+    image = std::move(it->second);
+    m_ThumbnailPending.erase(it);
+
+    return true;
+}
+
+// Passes a finished thumbnail to the main thread, can be called from any thread
+void ImageList::add_thumbnail(const size_t i, Glib::RefPtr<Gdk::Pixbuf> thumb)
+{
+    if (m_ThumbnailCancel->is_cancelled())
+        return;
+
+    if (!thumb)
+        thumb = Image::get_missing_pixbuf();
+
+    m_ThumbnailQueue.emplace(i, std::move(thumb));
+    m_SignalThumbnailLoaded();
+}
+
+// Moving the focus reorders the remaining thumbnails without touching the loaded or
+// loading ones
+void ImageList::set_thumbnail_focus(const size_t index)
+{
+    std::scoped_lock lock{ m_ThumbnailMutex };
+    m_ThumbnailFocus = index;
+}
+
+void ImageList::clear_thumbnail_queue()
+{
+    std::scoped_lock lock{ m_ThumbnailMutex };
+    m_ThumbnailPending.clear();
+    m_ThumbnailRequested.clear();
 }
 
 // Resets the image list to it's initial state
 void ImageList::reset()
 {
+    cancel_scan();
+    cancel_metadata();
+    for (ArchivePrefetch& p : m_ArchivePrefetch)
+        cancel_archive_prefetch(p);
+    cancel_directory_changes();
     cancel_cache();
 
     if (m_FileMonitor)
@@ -268,10 +419,12 @@ void ImageList::reset()
     cancel_thumbnail_thread();
 
     m_Images.clear();
+    m_ImageIndices.clear();
     m_Widget->clear();
 
     m_Archive = nullptr;
     m_ArchiveEntries.clear();
+    m_DirPath.clear();
     m_Index = 0;
 }
 
@@ -279,13 +432,447 @@ void ImageList::cancel_thumbnail_thread()
 {
     m_ThumbnailCancel->cancel();
 
-    m_ThreadPool.kill();
-    if (m_ThumbnailThread.joinable())
-        m_ThumbnailThread.join();
+    m_ThumbnailExecutor.kill();
 
+    clear_thumbnail_queue();
     m_ThumbnailQueue.clear();
 }
 
+// Reads dir_path on the scan thread and passes sorted batches of valid image paths
+// to the main thread. skip is the path of the image that was opened and is already in the list.
+void ImageList::scan_directory(const std::string& dir_path, const std::string& skip)
+{
+    using namespace std::chrono;
+    std::vector<std::string> batch;
+    auto last_flush{ steady_clock::now() };
+
+    auto flush = [&]() {
+        NaturalSort::sort(batch);
+        m_ScanQueue.push(std::move(batch));
+        batch      = {};
+        last_flush = steady_clock::now();
+        m_SignalScanBatch();
+    };
+
+    try
+    {
+        Glib::Dir dir(dir_path);
+        for (auto&& i : dir)
+        {
+            if (m_ScanCancel->is_cancelled())
+                return;
+
+            std::string path{ Glib::build_filename(dir_path, i) };
+            if (path == skip || !Image::is_valid_extension(path))
+                continue;
+
+            batch.push_back(std::move(path));
+
+            if (batch.size() >= ScanBatchSize ||
+                steady_clock::now() >= last_flush + milliseconds(ScanBatchInterval))
+                flush();
+        }
+    }
+    catch (const Glib::FileError& e)
+    {
+        std::cerr << "Failed to read directory '" << dir_path << "'" << std::endl
+                  << "  " << e.what() << std::endl;
+    }
+
+    if (!batch.empty())
+        flush();
+
+    m_ScanFinished = true;
+    m_SignalScanBatch();
+}
+
+// Merges a sorted batch of paths into m_Images, m_Index and m_Cache are
+// remapped so the current image and cache stay the same
+void ImageList::merge_entries(std::vector<std::string> entries)
+{
+    ImageVector added_images, images;
+    std::vector<size_t> remap(m_Images.size()), inserted;
+
+    added_images.reserve(entries.size());
+    for (std::string& e : entries)
+    {
+        // The directory monitor and the scan may both find the same file
+        if (m_ImageIndices.find(e) == m_ImageIndices.end())
+            added_images.push_back(std::make_shared<Image>(std::move(e)));
+    }
+
+    if (added_images.empty())
+        return;
+
+    // Thumbnail tasks refer to rows by index, stop them before any row moves
+    const bool thumbnails{ !is_scanning() };
+    if (thumbnails)
+        cancel_thumbnail_thread();
+
+    auto it{ added_images.begin() };
+    images.reserve(m_Images.size() + added_images.size());
+    inserted.reserve(added_images.size());
+
+    for (size_t i = 0; i < m_Images.size(); ++i)
+    {
+        for (; it != added_images.end() && (*it)->get_sort_key() < m_Images[i]->get_sort_key();
+             ++it)
+        {
+            inserted.push_back(images.size());
+            images.push_back(std::move(*it));
+        }
+
+        remap[i] = images.size();
+        images.push_back(std::move(m_Images[i]));
+    }
+
+    for (; it != added_images.end(); ++it)
+    {
+        inserted.push_back(images.size());
+        images.push_back(std::move(*it));
+    }
+
+    // Thumbnails are not loaded until the scan is done so the new rows
+    // can simply be appended, all of them are empty
+    if (!thumbnails)
+    {
+        m_Widget->reserve(inserted.size());
+    }
+    else
+    {
+        // Ascending order, every row before i is already in its final position
+        for (const size_t i : inserted)
+            m_Widget->insert(i, Glib::RefPtr<Gdk::Pixbuf>{});
+    }
+
+    m_Images = std::move(images);
+    m_Index  = remap[m_Index];
+
+    for (size_t& i : m_Cache)
+        i = remap[i];
+
+    update_indices();
+    update_cache();
+    m_Widget->set_selected(m_Index);
+
+    if (thumbnails)
+        load_thumbnails();
+
+    m_SignalSizeChanged();
+}
+
+// Removes the images at the given indices, the current image is replaced by
+// the closest image before it
+void ImageList::erase_images(std::vector<size_t> indices)
+{
+    if (indices.empty())
+        return;
+
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+    // Thumbnail tasks refer to rows by index, stop them before any row moves
+    const bool thumbnails{ thumbnails_loading() };
+    if (thumbnails)
+        cancel_thumbnail_thread();
+
+    const bool current{ std::binary_search(indices.begin(), indices.end(), m_Index) };
+    constexpr size_t npos{ std::numeric_limits<size_t>::max() };
+    std::vector<size_t> remap(m_Images.size(), npos);
+    ImageVector images;
+
+    images.reserve(m_Images.size() - indices.size());
+
+    for (size_t i = 0, j = 0; i < m_Images.size(); ++i)
+    {
+        if (j < indices.size() && indices[j] == i)
+        {
+            ++j;
+            continue;
+        }
+
+        remap[i] = images.size();
+        images.push_back(std::move(m_Images[i]));
+    }
+
+    // Erase rows from the back so the indices stay valid
+    for (auto i{ indices.rbegin() }; i != indices.rend(); ++i)
+        m_Widget->erase(*i);
+
+    if (images.empty())
+    {
+        clear();
+        return;
+    }
+
+    // Number of images kept before the old m_Index
+    size_t index{ m_Index - (std::lower_bound(indices.begin(), indices.end(), m_Index) -
+                             indices.begin()) };
+
+    m_Images = std::move(images);
+
+    std::vector<size_t> cache;
+    for (const size_t i : m_Cache)
+        if (remap[i] != npos)
+            cache.push_back(remap[i]);
+    m_Cache = std::move(cache);
+
+    update_indices();
+
+    if (current)
+    {
+        set_current(std::min(index == 0 ? 0 : index - 1, m_Images.size() - 1), false, true);
+    }
+    else
+    {
+        m_Index = index;
+        update_cache();
+    }
+
+    if (thumbnails)
+        load_thumbnails();
+
+    m_SignalSizeChanged();
+}
+
+void ImageList::update_indices()
+{
+    m_ImageIndices.clear();
+    m_ImageIndices.reserve(m_Images.size());
+
+    for (size_t i = 0; i < m_Images.size(); ++i)
+        m_ImageIndices.emplace(m_Images[i]->get_path(), i);
+}
+
+void ImageList::cancel_scan()
+{
+    m_ScanCancel->cancel();
+
+    if (m_ScanThread.joinable())
+        m_ScanThread.join();
+
+    m_ScanQueue.clear();
+    m_ScanFinished = false;
+}
+
+void ImageList::cancel_directory_changes()
+{
+    m_DirChangesConn.disconnect();
+    m_PendingCreated.clear();
+    m_PendingDeleted.clear();
+
+    // Anything the monitor thread is still validating belongs to the old directory
+    std::scoped_lock lock{ m_MonitorMutex };
+    ++m_MonitorGeneration;
+    m_MonitorQueue.clear();
+    m_ScanQueue.clear();
+}
+
+// Handles all of the file monitor events since the last main loop iteration at once
+bool ImageList::process_directory_changes()
+{
+    std::vector<size_t> deleted;
+    for (const std::string& path : m_PendingDeleted)
+        if (auto it{ m_ImageIndices.find(path) }; it != m_ImageIndices.end())
+            deleted.push_back(it->second);
+    m_PendingDeleted.clear();
+
+    bool created{ false };
+    {
+        // Queued under the same lock the generation is bumped with, so no path is tagged
+        // with a generation that is being cancelled or missed by a waiting monitor thread
+        std::scoped_lock lock{ m_MonitorMutex };
+        for (const std::string& path : m_PendingCreated)
+        {
+            if (m_ImageIndices.find(path) == m_ImageIndices.end())
+            {
+                m_MonitorQueue.emplace(m_MonitorGeneration, path);
+                created = true;
+            }
+        }
+    }
+    m_PendingCreated.clear();
+
+    // Checking whether the files are valid images reads them, do that off the main thread
+    if (created)
+    {
+        if (!m_MonitorThread.joinable())
+            m_MonitorThread = std::thread([&]() {
+                std::pair<size_t, std::string> p;
+                while (m_MonitorQueue.wait_pop(p, [&]() { return m_MonitorStop.load(); }))
+                {
+                    // Take everything queued so far, paths from an old directory are dropped
+                    const size_t generation{ m_MonitorGeneration };
+                    std::vector<std::string> paths, valid;
+                    do
+                    {
+                        if (p.first == generation)
+                            paths.push_back(std::move(p.second));
+                    } while (m_MonitorQueue.pop(p));
+
+                    for (std::string& path : paths)
+                    {
+                        if (m_MonitorStop || generation != m_MonitorGeneration)
+                            break;
+                        if (Image::is_valid(path))
+                            valid.push_back(std::move(path));
+                    }
+
+                    if (valid.empty())
+                        continue;
+
+                    NaturalSort::sort(valid);
+                    {
+                        std::scoped_lock lock{ m_MonitorMutex };
+                        if (generation != m_MonitorGeneration)
+                            continue;
+                        m_ScanQueue.push(std::move(valid));
+                    }
+                    m_SignalScanBatch();
+                }
+            });
+    }
+
+    // May clear the list if every image was deleted
+    erase_images(std::move(deleted));
+
+    return false;
+}
+
+// Opens the archive d places away from the current one in m_ArchiveEntries on a background
+// thread, lists its entries and decompresses the pages that will be shown first.
+// The pages are decoded once the images have been created, see on_archive_prefetched
+void ImageList::prefetch_archive(const int d)
+{
+    size_t i = std::find(m_ArchiveEntries.begin(), m_ArchiveEntries.end(), m_Archive->get_path()) -
+               m_ArchiveEntries.begin();
+
+    if ((d > 0 && i + 1 >= m_ArchiveEntries.size()) || (d < 0 && i == 0))
+        return;
+
+    ArchivePrefetch& p{ m_ArchivePrefetch[d > 0] };
+    const std::string& path{ m_ArchiveEntries[i + d] };
+
+    if (p.path == path)
+        return;
+
+    cancel_archive_prefetch(p);
+
+    p.path = path;
+    p.cancel->reset();
+    p.thread = std::thread([&, d, path, count = Settings.get_int("CacheSize") + 1]() {
+        std::unique_ptr<Archive> archive{ Archive::create(path) };
+        if (!archive || p.cancel->is_cancelled())
+            return;
+
+        std::vector<std::string> entries{ archive->get_entries(Archive::IMAGES) };
+        if (entries.empty() || p.cancel->is_cancelled())
+            return;
+
+        NaturalSort::sort(entries);
+
+        // Going backwards starts at the last page
+        std::vector<std::string> files;
+        for (int n = 0; n < count && n < static_cast<int>(entries.size()); ++n)
+            files.push_back(entries[d > 0 ? n : entries.size() - 1 - n]);
+        archive->read_ahead(std::move(files));
+
+        p.archive = std::move(archive);
+        p.entries = std::move(entries);
+        p.ready   = true;
+        m_SignalArchivePrefetched();
+    });
+}
+
+void ImageList::cancel_archive_prefetch(ArchivePrefetch& p)
+{
+    p.cancel->cancel();
+
+    if (p.thread.joinable())
+        p.thread.join();
+
+    // The images reference the archive
+    p.images.clear();
+    p.archive.reset();
+    p.entries.clear();
+    p.path.clear();
+    p.ready = false;
+}
+
+// Moves a prefetched archive into the arguments if path is one of them
+bool ImageList::take_prefetched_archive(const std::string& path,
+                                        std::unique_ptr<Archive>& archive,
+                                        std::vector<std::string>& entries,
+                                        ImageVector& images)
+{
+    for (ArchivePrefetch& p : m_ArchivePrefetch)
+    {
+        if (p.path.empty() || p.path != path)
+            continue;
+
+        // Any pages that are still being decoded are left for the cache thread
+        p.cancel->cancel();
+        if (p.thread.joinable())
+            p.thread.join();
+
+        if (p.ready)
+        {
+            archive = std::move(p.archive);
+            entries = std::move(p.entries);
+            images  = std::move(p.images);
+        }
+
+        cancel_archive_prefetch(p);
+
+        return !!archive;
+    }
+
+    return false;
+}
+
+// Fills in the ImageInfo of every image, closest to the current image first.
+// Only files that are new or have changed since the last time the directory was
+// opened need their headers read, the index is written back once every image has been seen
+void ImageList::index_metadata()
+{
+    cancel_metadata();
+
+    std::vector<size_t> indices(m_Images.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::sort(indices.begin(), indices.end(), m_IndexSort);
+
+    ImageVector images;
+    images.reserve(indices.size());
+    for (const size_t i : indices)
+        images.push_back(m_Images[i]);
+
+    m_MetadataCancel->reset();
+    m_MetadataThread = std::thread([&, dir_path = m_DirPath, images = std::move(images)]() {
+        MetadataIndex index{ dir_path };
+
+        for (const auto& img : images)
+        {
+            if (m_MetadataCancel->is_cancelled())
+                break;
+
+            ImageInfo info;
+            if (index.lookup(img->get_path(), info))
+                img->set_info(info);
+        }
+
+        // Only prune entries of files that no longer exist if every image was looked up
+        index.save(!m_MetadataCancel->is_cancelled());
+    });
+}
+
+void ImageList::cancel_metadata()
+{
+    m_MetadataCancel->cancel();
+
+    if (m_MetadataThread.joinable())
+        m_MetadataThread.join();
+}
+
 // Returns an unsorted vector of the paths to valid T's.
 // T must have a static method ::is_valid_extension, ie Image and Archive
 template<typename T>
@@ -310,6 +897,49 @@ std::vector<std::string> ImageList::get_entries(const std::string& path) const
     return entries;
 }
 
+void ImageList::on_scan_batch()
+{
+    std::vector<std::string> batch;
+
+    while (!m_ScanCancel->is_cancelled() && m_ScanQueue.pop(batch))
+        merge_entries(std::move(batch));
+
+    if (m_ScanFinished && m_ScanThread.joinable())
+    {
+        m_ScanThread.join();
+        m_ScanFinished = false;
+
+        load_thumbnails();
+        index_metadata();
+    }
+}
+
+// Archive::Images are created here on the main thread because of their dispatchers,
+// the first pages are then decoded in the background
+void ImageList::on_archive_prefetched()
+{
+    for (const int d : { -1, 1 })
+    {
+        ArchivePrefetch& p{ m_ArchivePrefetch[d > 0] };
+
+        if (!p.ready || !p.images.empty() || p.cancel->is_cancelled())
+            continue;
+
+        p.thread.join();
+
+        p.images.reserve(p.entries.size());
+        for (const std::string& e : p.entries)
+            p.images.push_back(std::make_shared<Archive::Image>(e, *p.archive));
+
+        const size_t count{ std::min(static_cast<size_t>(Settings.get_int("CacheSize")) + 1,
+                                     p.images.size()) };
+        p.thread = std::thread([&p, d, count]() {
+            for (size_t n = 0; n < count && !p.cancel->is_cancelled(); ++n)
+                p.images[d > 0 ? n : p.images.size() - 1 - n]->load_pixbuf(p.cancel);
+        });
+    }
+}
+
 void ImageList::on_thumbnail_loaded()
 {
     m_ThumbnailLoadedConn.block();
@@ -320,7 +950,7 @@ void ImageList::on_thumbnail_loaded()
 
     m_ThumbnailLoadedConn.unblock();
 
-    if (!m_ThreadPool.active())
+    if (!thumbnails_loading())
         m_SignalThumbnailsLoaded();
 }
 
@@ -331,73 +961,37 @@ void ImageList::on_directory_changed(const Glib::RefPtr<Gio::File>& file,
     if (!file)
         return;
 
-    ImageVector::iterator it;
-    auto comp = [&file](const std::shared_ptr<Image>& i) {
-        return i->get_path() == file->get_path();
-    };
+    std::string path{ file->get_path() };
 
     if (event == Gio::FILE_MONITOR_EVENT_DELETED)
     {
-        if ((it = std::find_if(m_Images.begin(), m_Images.end(), comp)) != m_Images.end())
-        {
-            size_t index = it - m_Images.begin();
-            bool current = index == m_Index;
-
-            // Adjust m_Index if the deleted file was before it
-            if (index < m_Index)
-                --m_Index;
-
-            m_Widget->erase(index);
-            m_Images.erase(it);
-
-            if (current)
-            {
-                if (m_Images.empty())
-                {
-                    clear();
-                    return;
-                }
-                else
-                {
-                    set_current(index == 0 ? 0 : index - 1, false, true);
-                }
-            }
-            else
-            {
-                update_cache();
-            }
-
-            m_SignalSizeChanged();
-        }
-        else if (file->get_path() == Glib::path_get_dirname(get_current()->get_path()))
+        // The directory itself was deleted
+        if (!empty() && path == Glib::path_get_dirname(get_current()->get_path()))
         {
             clear();
+            return;
         }
+
+        m_PendingCreated.erase(path);
+        m_PendingDeleted.insert(std::move(path));
     }
     // The changed event is used in case the created event was too quick,
     // and the file was invalid while still being written
     else if ((event == Gio::FILE_MONITOR_EVENT_CREATED ||
               event == Gio::FILE_MONITOR_EVENT_CHANGES_DONE_HINT) &&
-             Image::is_valid(file->get_path()))
+             Image::is_valid_extension(path))
     {
-        // Make sure the image wasn't already added
-        if (event == Gio::FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
-            std::find_if(m_Images.begin(), m_Images.end(), comp) != m_Images.end())
-            return;
-
-        std::shared_ptr<Image> img = std::make_shared<Image>(file->get_path());
-        it           = std::lower_bound(m_Images.begin(), m_Images.end(), img, NaturalSort());
-        size_t index = it - m_Images.begin();
-
-        if (index <= m_Index)
-            ++m_Index;
-
-        m_Widget->insert(index, img->get_thumbnail(m_ThumbnailCancel));
-        m_Images.insert(it, img);
-
-        update_cache();
-        m_SignalSizeChanged();
+        m_PendingDeleted.erase(path);
+        m_PendingCreated.insert(std::move(path));
     }
+    else
+    {
+        return;
+    }
+
+    if (!m_DirChangesConn)
+        m_DirChangesConn = Glib::signal_idle().connect(
+            sigc::mem_fun(*this, &ImageList::process_directory_changes));
 }
 
 void ImageList::set_current_relative(const int d)
@@ -427,7 +1021,9 @@ void ImageList::update_cache()
     std::iota(cache.begin(), cache.end(), 0);
     std::sort(cache.begin(), cache.end(), m_IndexSort);
 
-    cache.resize(Settings.get_int("CacheSize") * 2 + 1);
+    // Small lists may have fewer images than the cache can hold
+    cache.resize(
+        std::min(cache.size(), static_cast<size_t>(Settings.get_int("CacheSize")) * 2 + 1));
 
     // Get the indices of the images no longer in the cache
     if (!m_Cache.empty())
@@ -448,17 +1044,16 @@ void ImageList::update_cache()
         if (i <= m_Images.size() - 1)
             m_Images[i]->reset_pixbuf();
 
-    // Copy the imgaes into the queue and
-    // tell the cache thread it has some work
+    // The current image goes ahead of anything else queued on the shared executor
     for (const auto i : m_Cache)
-    {
-        m_CacheQueue.push(m_Images[i]);
-        m_CacheCond.notify_one();
-    }
+        m_CacheExecutor.push(
+            [img = m_Images[i], cancel = m_CacheCancel]() { img->load_pixbuf(cancel); },
+            i == m_Index ? Executor::Priority::VISIBLE : Executor::Priority::PREFETCH);
 }
 
+// The image that is currently loading is left to finish
 void ImageList::cancel_cache()
 {
     m_Cache.clear();
-    m_CacheQueue.clear();
+    m_CacheExecutor.cancel();
 }
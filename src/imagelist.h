@@ -1,14 +1,20 @@
 #pragma once
 
 #include "archive/archive.h"
+#include "executor.h"
 #include "image.h"
-#include "threadpool.h"
 #include "tsqueue.h"
+#include "uidispatcher.h"
 #include "util.h"
 
+#include <array>
 #include <gtkmm.h>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace AhoViewer
@@ -27,6 +33,19 @@ namespace AhoViewer
         // Used for async thumbnail pixbuf loading
         using PixbufPair = std::pair<size_t, Glib::RefPtr<Gdk::Pixbuf>>;
 
+        // An archive next to the current one that is opened before it's needed.
+        // Everything but images and thread is set by the thread before ready is set
+        struct ArchivePrefetch
+        {
+            std::string path;
+            std::unique_ptr<Archive> archive;
+            std::vector<std::string> entries;
+            ImageVector images;
+            std::atomic<bool> ready{ false };
+            Glib::RefPtr<Gio::Cancellable> cancel{ Gio::Cancellable::create() };
+            std::thread thread;
+        };
+
     public:
         // ImageList::Widget {{{
         // This is used by ThumbnailBar and Booru::Page.
@@ -109,6 +128,9 @@ namespace AhoViewer
         bool can_go_next() const;
         bool can_go_previous() const;
 
+        // True while the directory scan started by load is still adding images
+        bool is_scanning() const { return m_ScanThread.joinable(); }
+
         virtual size_t get_size() const { return m_Images.size(); }
 
         size_t get_index() const { return m_Index; }
@@ -137,8 +159,17 @@ namespace AhoViewer
 
     protected:
         virtual void load_thumbnails();
+        // Starts loading n of the rows queued by load_thumbnails
+        virtual void schedule_thumbnails(size_t n);
+        virtual bool thumbnails_loading() const { return m_ThumbnailExecutor.active(); }
+        bool take_thumbnail(size_t& i, std::shared_ptr<Image>& image);
+        void add_thumbnail(const size_t i, Glib::RefPtr<Gdk::Pixbuf> thumb);
         virtual void cancel_thumbnail_thread();
+        void set_thumbnail_focus(const size_t index);
+        void clear_thumbnail_queue();
         void update_cache();
+        // Indices of the current image and the ones being prefetched around it
+        const std::vector<size_t>& get_cached_indices() const { return m_Cache; }
 
         Widget* const m_Widget;
         ImageVector m_Images;
@@ -147,8 +178,15 @@ namespace AhoViewer
         ScrollPos m_ScrollPos;
 
         Glib::RefPtr<Gio::Cancellable> m_ThumbnailCancel;
-        std::thread m_ThumbnailThread;
-        ThreadPool m_ThreadPool;
+        Executor::Client m_ThumbnailExecutor;
+        // Rows waiting for a thumbnail, each thumbnail task loads whichever is closest to
+        // m_ThumbnailFocus when it starts so moving around never restarts anything.
+        // The image is kept with its row so tasks never read m_Images
+        std::map<size_t, std::shared_ptr<Image>> m_ThumbnailPending;
+        // Rows that have been queued since the last cancel, including finished ones
+        std::vector<bool> m_ThumbnailRequested;
+        size_t m_ThumbnailFocus{ 0 };
+        std::mutex m_ThumbnailMutex;
         TSQueue<PixbufPair> m_ThumbnailQueue;
 
         SignalChangedType m_SignalChanged;
@@ -159,30 +197,86 @@ namespace AhoViewer
         template<typename T>
         std::vector<std::string> get_entries(const std::string& path) const;
 
+        void scan_directory(const std::string& dir_path, const std::string& skip);
+        void merge_entries(std::vector<std::string> entries);
+        void erase_images(std::vector<size_t> indices);
+        void update_indices();
+        void cancel_scan();
+        void cancel_directory_changes();
+        bool process_directory_changes();
+        void index_metadata();
+        void cancel_metadata();
+
+        void on_scan_batch();
         void on_thumbnail_loaded();
         void on_directory_changed(const Glib::RefPtr<Gio::File>& file,
                                   const Glib::RefPtr<Gio::File>&,
                                   Gio::FileMonitorEvent event);
 
         void set_current_relative(const int d);
+        void prefetch_archive(const int d);
+        void cancel_archive_prefetch(ArchivePrefetch& p);
+        bool take_prefetched_archive(const std::string& path,
+                                     std::unique_ptr<Archive>& archive,
+                                     std::vector<std::string>& entries,
+                                     ImageVector& images);
+        void on_archive_prefetched();
+        void read_ahead();
         void cancel_cache();
 
         // Indicies of the Images in the current cache
         std::vector<size_t> m_Cache;
-        // A queue of Images that need to be loaded
-        TSQueue<std::shared_ptr<Image>> m_CacheQueue;
+        // Loads the cached Images one at a time, the current one first
+        Executor::Client m_CacheExecutor{ 1 };
         std::unique_ptr<Archive> m_Archive;
         std::vector<std::string> m_ArchiveEntries;
         std::function<int(size_t, size_t)> m_IndexSort;
+        // 1 when paging forward, -1 when paging backward
+        int m_ReadDirection{ 1 };
 
         Glib::RefPtr<Gio::Cancellable> m_CacheCancel;
-        std::atomic<bool> m_CacheStop{ false };
-        std::condition_variable m_CacheCond;
-        std::mutex m_CacheMutex, m_ThumbnailMutex;
-        std::thread m_CacheThread;
         Glib::RefPtr<Gio::FileMonitor> m_FileMonitor;
 
-        Glib::Dispatcher m_SignalThumbnailLoaded;
+        // Index of each image in m_Images by path, kept in sync with every batch
+        std::unordered_map<std::string, size_t> m_ImageIndices;
+
+        // File monitor events are collected here and handled together once per main loop
+        // iteration by process_directory_changes
+        std::unordered_set<std::string> m_PendingCreated, m_PendingDeleted;
+        sigc::connection m_DirChangesConn;
+
+        // Created files are validated on m_MonitorThread, the valid ones are passed back
+        // through m_ScanQueue the same way the directory scan does
+        TSQueue<std::pair<size_t, std::string>> m_MonitorQueue;
+        std::atomic<size_t> m_MonitorGeneration{ 0 };
+        std::atomic<bool> m_MonitorStop{ false };
+        std::mutex m_MonitorMutex;
+        std::thread m_MonitorThread;
+
+        // Sorted batches of paths found by the directory scan thread
+        TSQueue<std::vector<std::string>> m_ScanQueue;
+        Glib::RefPtr<Gio::Cancellable> m_ScanCancel;
+        std::atomic<bool> m_ScanFinished{ false };
+        std::thread m_ScanThread;
+
+        // Header information of every image in m_DirPath is read or loaded from the
+        // directory's MetadataIndex on this thread once the directory has been read
+        std::string m_DirPath;
+        Glib::RefPtr<Gio::Cancellable> m_MetadataCancel;
+        std::thread m_MetadataThread;
+
+        // With AutoOpenArchive the previous [0] and next [1] archives are opened once the
+        // current image is within CacheSize images of either end
+        std::array<ArchivePrefetch, 2> m_ArchivePrefetch;
+
+        Glib::Dispatcher m_SignalArchivePrefetched, m_SignalScanBatch;
+        UIDispatcher m_SignalThumbnailLoaded;
+
+        // Maximum number of paths (or time in ms) the scan thread collects before
+        // handing a batch to the main thread
+        static constexpr size_t ScanBatchSize{ 1024 }, ScanBatchInterval{ 100 };
+        // Number of archive pages read ahead past the cache
+        static constexpr int ReadAheadCount{ 16 };
 
         sigc::connection m_ThumbnailLoadedConn;
 
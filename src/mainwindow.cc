@@ -66,6 +66,8 @@ MainWindow::MainWindow(BaseObjectType* cobj, Glib::RefPtr<Gtk::Builder> bldr)
     m_LocalImageList->signal_size_changed().connect([&]() {
         if (m_LocalImageList == m_ActiveImageList)
         {
+            m_StatusBar->set_page_info(m_LocalImageList->get_index() + 1,
+                                       m_LocalImageList->get_size());
             update_title();
             set_sensitives();
         }
@@ -1049,6 +1051,10 @@ void MainWindow::on_imagelist_changed(const std::shared_ptr<Image>& image)
     m_StatusBar->set_page_info(m_ActiveImageList->get_index() + 1, m_ActiveImageList->get_size());
     m_StatusBar->set_filename(image->get_filename());
 
+    // The image box updates this with the scale once the image is drawn
+    if (ImageInfo info; image->get_info(info))
+        m_StatusBar->set_resolution(info.width, info.height);
+
     m_ImageBox->set_image(image);
     set_sensitives();
 }
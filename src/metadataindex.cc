@@ -0,0 +1,155 @@
+#include "metadataindex.h"
+using namespace AhoViewer;
+
+#include "config.h"
+
+#include <fstream>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Bump this if the line format below changes, old indices will be ignored
+#define INDEX_VERSION "1"
+
+const std::string MetadataIndex::IndexDir =
+    Glib::build_filename(Glib::get_user_cache_dir(), PACKAGE, "index");
+
+MetadataIndex::MetadataIndex(std::string dir_path)
+    : m_DirPath{ std::move(dir_path) },
+      m_IndexPath{ Glib::build_filename(
+          IndexDir,
+          Glib::Checksum::compute_checksum(Glib::Checksum::CHECKSUM_MD5,
+                                           Glib::filename_to_uri(m_DirPath))) }
+{
+    load();
+}
+
+bool MetadataIndex::lookup(const std::string& path, ImageInfo& info)
+{
+    GStatBuf st;
+    if (g_stat(path.c_str(), &st) != 0)
+        return false;
+
+    std::string name{ Glib::path_get_basename(path) };
+    {
+        std::scoped_lock lock{ m_Mutex };
+        m_Seen.insert(name);
+
+        auto it{ m_Entries.find(name) };
+        if (it != m_Entries.end() && it->second.mtime == st.st_mtime &&
+            it->second.size == st.st_size)
+        {
+            info = it->second;
+            return true;
+        }
+    }
+
+    if (!probe(path, info))
+        return false;
+
+    info.mtime = st.st_mtime;
+    info.size  = st.st_size;
+
+    std::scoped_lock lock{ m_Mutex };
+    m_Entries[name] = info;
+    m_Dirty         = true;
+
+    return true;
+}
+
+void MetadataIndex::save(const bool prune)
+{
+    std::scoped_lock lock{ m_Mutex };
+
+    if (prune)
+    {
+        for (auto it{ m_Entries.begin() }; it != m_Entries.end();)
+        {
+            if (m_Seen.find(it->first) == m_Seen.end())
+            {
+                it      = m_Entries.erase(it);
+                m_Dirty = true;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    if (!m_Dirty)
+        return;
+
+    std::ostringstream ss;
+    ss << "# " PACKAGE " metadata index " INDEX_VERSION << std::endl;
+
+    for (const auto& [name, info] : m_Entries)
+        ss << Glib::strescape(name) << '\t' << info.mtime << '\t' << info.size << '\t'
+           << info.width << '\t' << info.height << '\t' << info.format << std::endl;
+
+    if (!Glib::file_test(IndexDir, Glib::FILE_TEST_EXISTS))
+        g_mkdir_with_parents(IndexDir.c_str(), 0700);
+
+    try
+    {
+        Glib::file_set_contents(m_IndexPath, ss.str());
+        m_Dirty = false;
+    }
+    catch (const Glib::FileError& ex)
+    {
+        std::cerr << "Glib::file_set_contents: " << ex.what() << std::endl;
+    }
+}
+
+bool MetadataIndex::probe(const std::string& path, ImageInfo& info)
+{
+    GdkPixbufFormat* format{ gdk_pixbuf_get_file_info(path.c_str(), &info.width, &info.height) };
+
+    if (!format)
+        return false;
+
+    gchar* name{ gdk_pixbuf_format_get_name(format) };
+    info.format = name;
+    g_free(name);
+
+    return true;
+}
+
+void MetadataIndex::load()
+{
+    std::ifstream ifs(m_IndexPath);
+    std::string line;
+
+    if (!ifs || !std::getline(ifs, line) ||
+        line != "# " PACKAGE " metadata index " INDEX_VERSION)
+        return;
+
+    while (std::getline(ifs, line))
+    {
+        std::istringstream ls(line);
+        std::vector<std::string> fields;
+
+        for (std::string f; std::getline(ls, f, '\t');)
+            fields.push_back(std::move(f));
+
+        if (fields.size() != 6)
+            continue;
+
+        try
+        {
+            ImageInfo info;
+            info.mtime  = std::stoll(fields[1]);
+            info.size   = std::stoll(fields[2]);
+            info.width  = std::stoi(fields[3]);
+            info.height = std::stoi(fields[4]);
+            info.format = fields[5];
+
+            m_Entries.emplace(Glib::strcompress(fields[0]), std::move(info));
+        }
+        catch (const std::logic_error&)
+        {
+        }
+    }
+}
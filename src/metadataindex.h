@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glibmm.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace AhoViewer
+{
+    // Information about an image file that can be read from its header without decoding it
+    struct ImageInfo
+    {
+        std::string format;
+        int width{ 0 }, height{ 0 };
+        gint64 mtime{ 0 }, size{ 0 };
+    };
+
+    // On disk index of ImageInfo for every image in a directory.
+    // It is stored in the user's cache directory so reopening a directory only has to
+    // stat each file instead of reading its header again.
+    class MetadataIndex
+    {
+    public:
+        MetadataIndex(std::string dir_path);
+        ~MetadataIndex() = default;
+
+        // Fills info for the file at path, the header is only read if the file is not in
+        // the index or has been modified since it was indexed.
+        // Returns false if the file is not a valid image.
+        bool lookup(const std::string& path, ImageInfo& info);
+        // Writes the index back to disk if anything was added or changed.
+        // When prune is true, entries that were not looked up (removed files) are dropped
+        void save(const bool prune);
+
+        // Reads the format and dimensions from the file's header
+        static bool probe(const std::string& path, ImageInfo& info);
+
+    private:
+        void load();
+
+        static const std::string IndexDir;
+
+        std::string m_DirPath, m_IndexPath;
+        // Keyed by file name
+        std::unordered_map<std::string, ImageInfo> m_Entries;
+        std::unordered_set<std::string> m_Seen;
+        bool m_Dirty{ false };
+        std::mutex m_Mutex;
+    };
+}
@@ -2,62 +2,154 @@
 
 #include "image.h"
 
+#include <algorithm>
 #include <cctype>
-#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace AhoViewer
 {
+    // Orders strings case insensitively with runs of digits compared by their numeric value.
+    // Each string is converted once into a collation key, comparing two keys with a plain
+    // byte comparison gives the same order as comparing the strings naturally.
     class NaturalSort
     {
     public:
-        bool operator()(const std::string& a, const std::string& b)
+        bool operator()(const std::string& a, const std::string& b) const
         {
-            return compare_natural(a.c_str(), b.c_str());
+            return make_key(a) < make_key(b);
         }
-        bool operator()(const std::shared_ptr<Image>& a, const std::shared_ptr<Image>& b)
+        bool operator()(const std::shared_ptr<Image>& a, const std::shared_ptr<Image>& b) const
         {
-            return compare_natural(a->get_path().c_str(), b->get_path().c_str());
+            return a->get_sort_key() < b->get_sort_key();
         }
 
-    private:
-        bool compare_natural(const char* a, const char* b)
+        // Key layout, one token after another:
+        //   digit run: 0x00, 2 byte big endian length, digits without leading zeros
+        //   character: 0x01-0x80 for bytes 0x80-0xFF, 0x81-0xFF for lowercased ASCII
+        //              (0xFF 0x00 for 0x7F)
+        //   end:       0xFF 0xFF
+        // Digit runs sort before characters and the end of a string sorts after everything.
+        // Bytes of UTF-8 sequences sort before ASCII, like they did when the strings were
+        // compared as signed chars
+        static std::string make_key(std::string_view s)
         {
-            // End of string
-            if (!a || !b)
-                return !!a;
+            std::string key;
+            key.reserve(s.size() + 2);
 
-            // Both are numbers, compare them as such
-            if (std::isdigit(*a) && std::isdigit(*b))
+            for (size_t i = 0; i < s.size();)
             {
-                char *a_after, *b_after;
-                unsigned long a_l = strtoul(a, &a_after, 10), b_l = strtoul(b, &b_after, 10);
+                if (std::isdigit(static_cast<unsigned char>(s[i])))
+                {
+                    size_t start{ i };
+                    while (i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])))
+                        ++i;
+
+                    auto digits{ s.substr(start, i - start) };
+                    digits.remove_prefix(std::min(digits.find_first_not_of('0'), digits.size()));
+                    size_t len{ std::min(digits.size(), size_t{ 0xFFFF }) };
+
+                    key.push_back('\x00');
+                    key.push_back(static_cast<char>(len >> 8));
+                    key.push_back(static_cast<char>(len & 0xFF));
+                    key.append(digits.data(), len);
+                }
+                else
+                {
+                    const int b{ static_cast<unsigned char>(s[i]) };
+                    const int c{ b >= 0x80 ? b - 0x7F : std::tolower(b) + 0x80 };
+                    if (c < 0xFF)
+                    {
+                        key.push_back(static_cast<char>(c));
+                    }
+                    else
+                    {
+                        key.push_back('\xFF');
+                        key.push_back(static_cast<char>(c - 0xFF));
+                    }
+                    ++i;
+                }
+            }
 
-                if (a_l != b_l)
-                    return a_l < b_l;
+            key.append("\xFF\xFF", 2);
+            return key;
+        }
+
+        // Sorts a vector of paths, each path's key is only computed once.
+        // Large vectors are split up and sorted on multiple threads
+        static void sort(std::vector<std::string>& v)
+        {
+            using KeyPair = std::pair<std::string, std::string>;
+            std::vector<KeyPair> keyed;
+            keyed.reserve(v.size());
 
-                return compare_natural(a_after, b_after);
+            for (auto& s : v)
+            {
+                std::string key{ make_key(s) };
+                keyed.emplace_back(std::move(key), std::move(s));
             }
 
-            // One of them is a number
-            if (std::isdigit(*a) || std::isdigit(*b))
-                return std::isdigit(*a);
+            auto comp = [](const KeyPair& a, const KeyPair& b) { return a.first < b.first; };
+            size_t n_threads{ std::max(std::thread::hardware_concurrency(), 1u) };
 
-            // Both of them are not numbers
-            while (*a && *b)
+            if (keyed.size() < ParallelThreshold || n_threads == 1)
             {
-                // Both letters were the same, are they numbers?
-                if (std::isdigit(*a) || std::isdigit(*b))
-                    return compare_natural(a, b);
+                std::sort(keyed.begin(), keyed.end(), comp);
+            }
+            else
+            {
+                // Sort each chunk on its own thread, then merge neighbouring chunks
+                // until only one is left
+                size_t chunk{ (keyed.size() + n_threads - 1) / n_threads };
+                std::vector<size_t> bounds;
+                std::vector<std::thread> threads;
+
+                for (size_t i = 0; i < keyed.size(); i += chunk)
+                    bounds.push_back(i);
+                bounds.push_back(keyed.size());
+
+                for (size_t i = 0; i + 1 < bounds.size(); ++i)
+                    threads.emplace_back([&, i]() {
+                        std::sort(keyed.begin() + bounds[i], keyed.begin() + bounds[i + 1], comp);
+                    });
+                for (auto& t : threads)
+                    t.join();
 
-                // Both are letters but different letters
-                if (std::tolower(*a) != std::tolower(*b))
-                    return std::tolower(*a) < std::tolower(*b);
+                while (bounds.size() > 2)
+                {
+                    std::vector<size_t> merged;
+                    threads.clear();
 
-                ++a;
-                ++b;
+                    for (size_t i = 0; i + 2 < bounds.size(); i += 2)
+                    {
+                        threads.emplace_back([&, i]() {
+                            std::inplace_merge(keyed.begin() + bounds[i],
+                                               keyed.begin() + bounds[i + 1],
+                                               keyed.begin() + bounds[i + 2],
+                                               comp);
+                        });
+                        merged.push_back(bounds[i]);
+                    }
+                    // Odd chunk out waits for the next pass
+                    if (bounds.size() % 2 == 0)
+                        merged.push_back(bounds[bounds.size() - 2]);
+                    merged.push_back(keyed.size());
+
+                    for (auto& t : threads)
+                        t.join();
+
+                    bounds = std::move(merged);
+                }
             }
 
-            return !!*a;
+            for (size_t i = 0; i < keyed.size(); ++i)
+                v[i] = std::move(keyed[i].second);
         }
+
+    private:
+        static constexpr size_t ParallelThreshold{ 16384 };
     };
 }
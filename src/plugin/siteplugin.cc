@@ -85,7 +85,9 @@ SitePlugin::parse_post_data(const unsigned char* data,
                                     Booru::get_rating_string(null_check_string(pd->rating)),
                                     null_check_string(pd->score) };
 
+                // Plugins only give the url chosen by the samples argument
                 posts_vec.emplace_back(null_check_string(pd->image_url),
+                                       "",
                                        null_check_string(pd->thumb_url),
                                        null_check_string(pd->post_url),
                                        null_check_string(pd->notes_url),
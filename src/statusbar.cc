@@ -30,6 +30,11 @@ void StatusBar::set_resolution(const int w,
     m_Resolution->set_text(ss.str());
 }
 
+void StatusBar::set_resolution(const int w, const int h)
+{
+    m_Resolution->set_text(std::to_string(w) + "x" + std::to_string(h));
+}
+
 void StatusBar::set_filename(const std::string& filename)
 {
     m_Filename->set_text(filename);
@@ -22,6 +22,8 @@ namespace AhoViewer
 
         void set_page_info(const size_t page, const size_t total);
         void set_resolution(const int w, const int h, const double scale, const ZoomMode zoom_mode);
+        // Used before the image has been loaded and drawn
+        void set_resolution(const int w, const int h);
         void set_filename(const std::string& filename);
         void set_message(const std::string& msg,
                          const Priority priority  = Priority::MESSAGE,
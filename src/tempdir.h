@@ -1,11 +1,14 @@
 #pragma once
 
 #include "config.h"
+#include "tsqueue.h"
 
+#include <atomic>
 #include <cstring>
 #include <glib/gstdio.h>
 #include <glibmm.h>
 #include <iostream>
+#include <thread>
 
 namespace AhoViewer
 {
@@ -44,28 +47,36 @@ namespace AhoViewer
 
             return path;
         }
+        // The directory is renamed to a tombstone right away so its name can be reused,
+        // the actual deleting is done later on the reaper thread
         void remove_dir(const std::string& dir_path)
         {
             // Make sure the directory is in the tempdir
-            if (dir_path.compare(0, m_Path.length(), m_Path) == 0)
-            {
-                Glib::Dir dir(dir_path);
-                for (auto&& i : dir)
-                {
-                    std::string path = Glib::build_filename(dir_path, i);
-                    if (Glib::file_test(path, Glib::FILE_TEST_IS_DIR))
-                        remove_dir(path);
-                    else
-                        g_unlink(path.c_str());
-                }
-                g_rmdir(dir_path.c_str());
-            }
+            if (dir_path.compare(0, m_Path.length(), m_Path) != 0)
+                return;
+
+            std::string tombstone{ Glib::build_filename(
+                m_Path, TombstonePrefix + std::to_string(m_Tombstones++)) };
+
+            if (g_rename(dir_path.c_str(), tombstone.c_str()) == 0)
+                queue_removal(std::move(tombstone));
+            else
+                queue_removal(dir_path);
         }
         std::string get_dir() const { return m_Path; }
 
     private:
         TempDir()
         {
+            std::string tmpl(Glib::build_filename(Glib::get_tmp_dir(), PACKAGE ".XXXXXX"));
+            m_Path = g_mkdtemp(const_cast<char*>(tmpl.c_str()));
+
+            m_ReaperThread = std::thread([&]() {
+                std::string path;
+                while (m_ReaperQueue.wait_pop(path, [&]() { return m_ReaperStop.load(); }))
+                    delete_dir(path);
+            });
+
             // Clean up previous temp directories if they exist
             Glib::Dir dir(Glib::get_tmp_dir());
             std::vector<std::string> dirs(dir.begin(), dir.end());
@@ -73,16 +84,54 @@ namespace AhoViewer
             for (auto& dir : dirs)
             {
                 // 7 = strlen(".XXXXXX")
+                std::string path{ Glib::build_filename(Glib::get_tmp_dir(), dir) };
                 if (dir.find(PACKAGE ".") != std::string::npos &&
-                    dir.length() == strlen(PACKAGE) + 7)
-                    remove_dir(Glib::build_filename(Glib::get_tmp_dir(), dir));
+                    dir.length() == strlen(PACKAGE) + 7 && path != m_Path)
+                    queue_removal(std::move(path));
             }
+        }
+        // Anything the reaper did not get to is deleted along with m_Path
+        ~TempDir()
+        {
+            m_ReaperStop = true;
+            m_ReaperQueue.wake();
+            m_ReaperThread.join();
 
-            std::string tmpl(Glib::build_filename(Glib::get_tmp_dir(), PACKAGE ".XXXXXX"));
-            m_Path = g_mkdtemp(const_cast<char*>(tmpl.c_str()));
+            delete_dir(m_Path);
+        }
+
+        void queue_removal(std::string path) { m_ReaperQueue.push(std::move(path)); }
+
+        static void delete_dir(const std::string& dir_path)
+        {
+            try
+            {
+                Glib::Dir dir(dir_path);
+                for (auto&& i : dir)
+                {
+                    std::string path = Glib::build_filename(dir_path, i);
+                    if (Glib::file_test(path, Glib::FILE_TEST_IS_DIR) &&
+                        !Glib::file_test(path, Glib::FILE_TEST_IS_SYMLINK))
+                        delete_dir(path);
+                    else
+                        g_unlink(path.c_str());
+                }
+            }
+            catch (const Glib::FileError& e)
+            {
+                std::cerr << "Failed to remove '" << dir_path << "'" << std::endl
+                          << "  " << e.what() << std::endl;
+            }
+            g_rmdir(dir_path.c_str());
         }
-        ~TempDir() { remove_dir(m_Path); }
+
+        static constexpr char TombstonePrefix[]{ ".removed-" };
 
         std::string m_Path;
+        std::atomic<size_t> m_Tombstones{ 0 };
+
+        TSQueue<std::string> m_ReaperQueue;
+        std::atomic<bool> m_ReaperStop{ false };
+        std::thread m_ReaperThread;
     };
 }
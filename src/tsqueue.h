@@ -1,53 +1,207 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace AhoViewer
 {
-    template<typename T>
+    // Multi producer, multi consumer queue.
+    // Values go into a fixed size lock free ring, when it is full they spill over into a
+    // locked deque until that has been drained again so nothing is ever dropped or reordered
+    // for a single producer. Consumers can block in wait_pop without a mutex and condition
+    // variable of their own.
+    template<typename T, size_t Capacity = 256>
     class TSQueue
     {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                      "Capacity must be a power of two");
+
     public:
-        void push(const T& v)
-        {
-            std::scoped_lock lock{ m_Mutex };
-            m_Queue.push(std::move(v));
-        }
-        void push(T&& v)
+        TSQueue()
         {
-            std::scoped_lock lock{ m_Mutex };
-            m_Queue.push(std::move(v));
+            for (size_t i = 0; i < Capacity; ++i)
+                m_Cells[i].seq.store(i, std::memory_order_relaxed);
         }
+        ~TSQueue() { clear(); }
+
+        void push(const T& v) { emplace(v); }
+        void push(T&& v) { emplace(std::move(v)); }
         template<typename... Args>
         void emplace(Args&&... v)
         {
-            std::scoped_lock lock{ m_Mutex };
-            m_Queue.emplace(std::forward<Args>(v)...);
+            ++m_Size;
+
+            // The arguments are only used by try_emplace once it has claimed a cell
+            if (m_Spilled != 0 || !try_emplace(std::forward<Args>(v)...))
+            {
+                std::scoped_lock lock{ m_SpillMutex };
+                m_Spill.emplace_back(std::forward<Args>(v)...);
+                ++m_Spilled;
+            }
+
+            // Pairs with the fence in wait_pop, either the waiter sees the new value or
+            // this sees the waiter
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_Waiters != 0)
+                wake();
         }
+
         bool pop(T& v)
         {
-            std::scoped_lock lock{ m_Mutex };
-            if (m_Queue.empty())
-                return false;
-            v = std::move(m_Queue.front());
-            m_Queue.pop();
-            return true;
+            if (try_pop(v) || pop_spill(v))
+            {
+                --m_Size;
+                return true;
+            }
+
+            return false;
         }
-        void clear()
+        // Blocks until there is a value or stop returns true, returns false when stopped.
+        // Whatever makes stop return true must be followed by a call to wake
+        template<typename Pred>
+        bool wait_pop(T& v, Pred stop)
         {
-            std::scoped_lock lock{ m_Mutex };
-            while (!m_Queue.empty())
-                m_Queue.pop();
+            if (!stop() && pop(v))
+                return true;
+
+            std::unique_lock<std::mutex> lock(m_WaitMutex);
+            ++m_Waiters;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            bool popped{ false };
+            m_WaitCond.wait(lock, [&]() { return stop() || (popped = pop(v)); });
+            --m_Waiters;
+
+            return popped;
+        }
+        // Wakes up every consumer blocked in wait_pop so they can check their stop condition
+        void wake()
+        {
+            {
+                std::scoped_lock lock{ m_WaitMutex };
+            }
+            m_WaitCond.notify_all();
         }
-        bool empty() const
+
+        void clear()
         {
-            std::scoped_lock lock{ m_Mutex };
-            return m_Queue.empty();
+            T v;
+            while (pop(v))
+                ;
         }
+        // Only a hint when other threads are pushing or popping at the same time
+        bool empty() const { return m_Size == 0; }
 
     private:
-        std::queue<T> m_Queue;
-        mutable std::mutex m_Mutex;
+        static constexpr size_t Mask{ Capacity - 1 };
+
+        // Each cell's sequence number tells producers and consumers whose turn it is,
+        // see Dmitry Vyukov's bounded MPMC queue
+        struct Cell
+        {
+            std::atomic<size_t> seq;
+            std::aligned_storage_t<sizeof(T), alignof(T)> storage;
+        };
+
+        template<typename... Args>
+        bool try_emplace(Args&&... v)
+        {
+            Cell* cell;
+            size_t pos{ m_Tail.load(std::memory_order_relaxed) };
+
+            while (true)
+            {
+                cell = &m_Cells[pos & Mask];
+                const size_t seq{ cell->seq.load(std::memory_order_acquire) };
+                const auto dif{ static_cast<std::ptrdiff_t>(seq - pos) };
+
+                if (dif == 0)
+                {
+                    if (m_Tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (dif < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = m_Tail.load(std::memory_order_relaxed);
+                }
+            }
+
+            new (&cell->storage) T(std::forward<Args>(v)...);
+            cell->seq.store(pos + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        bool try_pop(T& v)
+        {
+            Cell* cell;
+            size_t pos{ m_Head.load(std::memory_order_relaxed) };
+
+            while (true)
+            {
+                cell = &m_Cells[pos & Mask];
+                const size_t seq{ cell->seq.load(std::memory_order_acquire) };
+                const auto dif{ static_cast<std::ptrdiff_t>(seq - (pos + 1)) };
+
+                if (dif == 0)
+                {
+                    if (m_Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (dif < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = m_Head.load(std::memory_order_relaxed);
+                }
+            }
+
+            T* p{ std::launder(reinterpret_cast<T*>(&cell->storage)) };
+            v = std::move(*p);
+            p->~T();
+            cell->seq.store(pos + Capacity, std::memory_order_release);
+
+            return true;
+        }
+
+        bool pop_spill(T& v)
+        {
+            if (m_Spilled == 0)
+                return false;
+
+            std::scoped_lock lock{ m_SpillMutex };
+            if (m_Spill.empty())
+                return false;
+
+            v = std::move(m_Spill.front());
+            m_Spill.pop_front();
+            --m_Spilled;
+
+            return true;
+        }
+
+        // Producers and consumers are kept on separate cache lines
+        alignas(64) std::atomic<size_t> m_Tail{ 0 };
+        alignas(64) std::atomic<size_t> m_Head{ 0 };
+        alignas(64) Cell m_Cells[Capacity];
+
+        std::atomic<size_t> m_Size{ 0 }, m_Spilled{ 0 }, m_Waiters{ 0 };
+        std::deque<T> m_Spill;
+        std::mutex m_SpillMutex;
+
+        std::mutex m_WaitMutex;
+        std::condition_variable m_WaitCond;
     };
 }
@@ -0,0 +1,107 @@
+#include "uidispatcher.h"
+using namespace AhoViewer;
+
+#include <algorithm>
+#include <gdk/gdk.h>
+
+// Makes sure the mailbox is created first, and so outlives every dispatcher
+UIDispatcher::UIDispatcher()
+{
+    UIMailbox::get_instance();
+}
+
+// Always goes through the mailbox since emit may have queued this on another thread
+UIDispatcher::~UIDispatcher()
+{
+    UIMailbox::get_instance().remove(this);
+}
+
+void UIDispatcher::emit()
+{
+    UIMailbox& mailbox{ UIMailbox::get_instance() };
+    mailbox.m_Emits.fetch_add(1, std::memory_order_relaxed);
+
+    if (!m_Queued.exchange(true))
+        mailbox.post(this);
+}
+
+UIMailbox::~UIMailbox()
+{
+    if (m_SourceId)
+        g_source_remove(m_SourceId);
+}
+
+// The raw glib functions are used for the wakeup because, unlike the glibmm signals,
+// they can be called from any thread
+void UIMailbox::post(UIDispatcher* d)
+{
+    std::scoped_lock lock{ m_Mutex };
+    m_Queue.push_back(d);
+
+    if (m_SourceId)
+        return;
+
+    // Run just ahead of GTK's redraw, but never more often than DrainInterval
+    const gint64 wait{ m_LastDrain + DrainInterval - g_get_monotonic_time() };
+
+    if (wait > 0)
+        m_SourceId = g_timeout_add_full(GDK_PRIORITY_REDRAW - 1,
+                                        std::max(wait / 1000, gint64{ 1 }),
+                                        &UIMailbox::on_wakeup,
+                                        this,
+                                        nullptr);
+    else
+        m_SourceId = g_idle_add_full(GDK_PRIORITY_REDRAW - 1, &UIMailbox::on_wakeup, this, nullptr);
+}
+
+void UIMailbox::remove(UIDispatcher* d)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Queue.erase(std::remove(m_Queue.begin(), m_Queue.end(), d), m_Queue.end());
+    std::replace(m_Draining.begin(), m_Draining.end(), d, static_cast<UIDispatcher*>(nullptr));
+
+    // A handler destroying its own dispatcher can't wait for itself
+    if (std::this_thread::get_id() != m_DrainThread)
+        m_RunningCond.wait(lock, [&]() { return m_Running != d; });
+}
+
+gboolean UIMailbox::on_wakeup(gpointer userp)
+{
+    static_cast<UIMailbox*>(userp)->drain();
+    return G_SOURCE_REMOVE;
+}
+
+// Dispatchers emitted while this runs are left for the next drain
+void UIMailbox::drain()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    m_SourceId    = 0;
+    m_LastDrain   = g_get_monotonic_time();
+    m_DrainThread = std::this_thread::get_id();
+    m_Wakeups.fetch_add(1, std::memory_order_relaxed);
+
+    m_Draining.swap(m_Queue);
+
+    for (size_t i = 0; i < m_Draining.size(); ++i)
+    {
+        UIDispatcher* d{ m_Draining[i] };
+        if (!d)
+            continue;
+
+        // Reset before the handlers run so anything they miss gets queued again
+        d->m_Queued = false;
+        m_Running   = d;
+        m_Dispatches.fetch_add(1, std::memory_order_relaxed);
+
+        lock.unlock();
+        d->m_Signal();
+        lock.lock();
+
+        m_Running = nullptr;
+        m_RunningCond.notify_all();
+    }
+
+    m_Draining.clear();
+    m_DrainThread = std::thread::id();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <glib.h>
+#include <mutex>
+#include <sigc++/sigc++.h>
+#include <thread>
+#include <vector>
+
+namespace AhoViewer
+{
+    // Used in place of Glib::Dispatcher for notifications where only the latest state
+    // matters. Emitting queues the dispatcher in the UIMailbox unless it is already queued,
+    // so any number of emits between two drains reach the handlers once.
+    // It must be created on the main thread, but can be destroyed on any thread as long
+    // as nothing is emitting it at the same time. Destroying it on another thread waits
+    // for its handlers if they are running.
+    class UIDispatcher
+    {
+    public:
+        UIDispatcher();
+        ~UIDispatcher();
+
+        // Can be called from any thread
+        void emit();
+        void operator()() { emit(); }
+
+        sigc::connection connect(const sigc::slot<void>& slot) { return m_Signal.connect(slot); }
+
+    private:
+        friend class UIMailbox;
+
+        UIDispatcher(const UIDispatcher&) = delete;
+        UIDispatcher& operator=(const UIDispatcher&) = delete;
+
+        sigc::signal<void> m_Signal;
+        std::atomic<bool> m_Queued{ false };
+    };
+
+    // Collects the UIDispatchers emitted from any thread and runs their handlers on the
+    // main thread at most 60 times a second.
+    // This uses a plain main loop timeout at a priority just above GTK's redraw rather
+    // than a widget's frame clock, since most dispatchers aren't tied to a widget
+    class UIMailbox
+    {
+    public:
+        // Totals since startup: every emit, the ones that reached their handlers and
+        // the main loop wakeups they cost
+        struct Stats
+        {
+            size_t emits, dispatches, wakeups;
+        };
+
+        static UIMailbox& get_instance()
+        {
+            static UIMailbox i;
+            return i;
+        }
+
+        Stats get_stats() const { return { m_Emits, m_Dispatches, m_Wakeups }; }
+
+    private:
+        friend class UIDispatcher;
+
+        UIMailbox() = default;
+        ~UIMailbox();
+
+        void post(UIDispatcher* d);
+        void remove(UIDispatcher* d);
+        void drain();
+
+        static gboolean on_wakeup(gpointer userp);
+
+        static constexpr gint64 DrainInterval{ G_USEC_PER_SEC / 60 };
+
+        // m_Draining is what the current drain is working through, removed dispatchers
+        // are set to nullptr there. m_Running is the dispatcher whose handlers are being
+        // run by m_DrainThread, removing it from another thread waits until they return
+        std::vector<UIDispatcher*> m_Queue, m_Draining;
+        UIDispatcher* m_Running{ nullptr };
+        std::thread::id m_DrainThread;
+        guint m_SourceId{ 0 };
+        gint64 m_LastDrain{ 0 };
+        std::atomic<size_t> m_Emits{ 0 }, m_Dispatches{ 0 }, m_Wakeups{ 0 };
+
+        std::mutex m_Mutex;
+        std::condition_variable m_RunningCond;
+    };
+}
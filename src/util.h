@@ -115,9 +115,14 @@ namespace AhoViewer
             TAG  = 1,
         };
 
-        using PostDataTuple = std::
-            //    image_url    thumb_url    post_url     notes_url
-            tuple<std::string, std::string, std::string, std::string, std::vector<Tag>, PostInfo>;
+        // sample_url is empty when the site has no smaller version of the image
+        using PostDataTuple = std::tuple<std::string, // image_url
+                                         std::string, // sample_url
+                                         std::string, // thumb_url
+                                         std::string, // post_url
+                                         std::string, // notes_url
+                                         std::vector<Tag>,
+                                         PostInfo>;
 
         std::string format_date_time(const date::sys_seconds t);
         std::string get_rating_string(std::string_view rating);
@@ -0,0 +1,47 @@
+#include "booru/curler.h"
+#include "tempdir.h"
+#include "test.h"
+using namespace AhoViewer;
+using namespace AhoViewer::Booru;
+
+#include <cstring>
+#include <fstream>
+
+// Downloads a 10 MB file twice. The first download is only allowed a handful of buffer
+// allocations however it's split up, the second one should reuse them all from the pool
+int main()
+{
+    Gio::init();
+
+    constexpr size_t Size{ 10 * 1024 * 1024 }, ChunkSize{ 256 * 1024 };
+    std::vector<unsigned char> data(Size);
+    for (size_t i = 0; i < Size; ++i)
+        data[i] = static_cast<unsigned char>(i * 31 % 251);
+
+    auto dir{ TempDir::get_instance().make_dir() };
+    auto path{ Glib::build_filename(dir, "download") };
+    std::ofstream{ path, std::ios::binary }.write(reinterpret_cast<const char*>(data.data()),
+                                                 data.size());
+
+    Curler curler{ Glib::filename_to_uri(path) };
+
+    for (const size_t max_allocations : { Size / ChunkSize + 2, size_t{ 0 } })
+    {
+        const size_t before{ Curler::get_buffer_allocations() };
+
+        CHECK(curler.perform());
+        CHECK(curler.get_data_size() == Size);
+        CHECK(curler.get_data_size() == Size &&
+              std::memcmp(curler.get_data(), data.data(), Size) == 0);
+
+        const size_t allocations{ Curler::get_buffer_allocations() - before };
+        std::cout << allocations << " allocations for " << Size << " bytes" << std::endl;
+        CHECK(allocations <= max_allocations);
+
+        curler.clear();
+    }
+
+    TempDir::get_instance().remove_dir(dir);
+
+    return TEST_RESULT();
+}
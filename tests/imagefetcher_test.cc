@@ -0,0 +1,39 @@
+#include "booru/imagefetcher.h"
+#include "tempdir.h"
+#include "test.h"
+using namespace AhoViewer;
+using namespace AhoViewer::Booru;
+
+#include <fstream>
+
+// Samples are preferred until something has been measured, a single image smaller than
+// a typical sample has to be enough to measure a fast host
+int main()
+{
+    Gio::init();
+
+    auto dir{ TempDir::get_instance().make_dir() };
+    auto path{ Glib::build_filename(dir, "sample.jpg") };
+    std::ofstream{ path, std::ios::binary } << std::string(64 * 1024, 'x');
+
+    const std::string url{ Glib::filename_to_uri(path) };
+    auto loop{ Glib::MainLoop::create() };
+    ImageFetcher fetcher{ false };
+    Curler curler{ url };
+
+    CHECK(fetcher.prefer_samples(url));
+
+    curler.signal_finished().connect([&]() { loop->quit(); });
+    fetcher.add_handle(&curler, ImageFetcher::Priority::IMAGE);
+
+    Glib::signal_timeout().connect_seconds_once([&]() { loop->quit(); }, 10);
+    loop->run();
+
+    CHECK(!curler.is_active() && curler.get_response() == CURLE_OK);
+    CHECK(!fetcher.prefer_samples(url));
+
+    fetcher.shutdown();
+    TempDir::get_instance().remove_dir(dir);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,122 @@
+#include "imagelist.h"
+#include "settings.h"
+#include "tempdir.h"
+#include "test.h"
+using namespace AhoViewer;
+
+#include <chrono>
+#include <cstring>
+#include <glib/gstdio.h>
+
+namespace
+{
+    class TestWidget : public ImageList::Widget
+    {
+    public:
+        void set_selected(const size_t) override { }
+        void scroll_to_selected() override { }
+    };
+
+    // Every image has a different height so a row's thumbnail tells which image it
+    // was loaded from. Thumbnails are a tenth of the size
+    constexpr int ImageWidth{ 1000 };
+    constexpr size_t ImageCount{ 400 };
+    int thumbnail_height(const size_t n)
+    {
+        return 10 + static_cast<int>(n % 80);
+    }
+
+    std::string write_image(const std::string& dir, const size_t n)
+    {
+        auto path{ Glib::build_filename(dir, "image-" + std::to_string(n) + ".png") };
+        auto pixbuf{ Gdk::Pixbuf::create(
+            Gdk::COLORSPACE_RGB, false, 8, ImageWidth, thumbnail_height(n) * 10) };
+
+        pixbuf->fill(0x336699ff);
+        pixbuf->save(path, "png");
+
+        return path;
+    }
+
+    size_t image_number(const std::string& path)
+    {
+        return std::stoul(Glib::path_get_basename(path).substr(std::strlen("image-")));
+    }
+}
+
+// Images moved into the directory are merged into the list while the thumbnails of the
+// ones that were already there are loading, every row should end up with its own thumbnail
+int main()
+{
+    Gtk::Main::init_gtkmm_internals();
+    Settings.set("SaveThumbnails", false);
+
+    auto dir{ TempDir::get_instance().make_dir() },
+        staging{ TempDir::get_instance().make_dir() };
+    std::vector<std::string> added;
+
+    for (size_t n = 0; n < ImageCount; ++n)
+    {
+        if (n % 2 == 0)
+            write_image(dir, n);
+        else
+            added.push_back(write_image(staging, n));
+    }
+
+    TestWidget widget;
+    ImageList list{ &widget };
+    std::string error;
+
+    CHECK(list.load(dir, error));
+
+    for (const std::string& path : added)
+        g_rename(path.c_str(), Glib::build_filename(dir, Glib::path_get_basename(path)).c_str());
+
+    auto has_thumbnail = [&](const size_t i) {
+        auto it{ widget.m_ListStore->get_iter(std::to_string(i)) };
+        return it && it->get_value(widget.m_Columns.pixbuf);
+    };
+    auto loop{ Glib::MainLoop::create() };
+    auto start{ std::chrono::steady_clock::now() };
+
+    Glib::signal_timeout().connect(
+        [&]() {
+            bool done{ list.get_size() == ImageCount };
+            for (size_t i = 0; done && i < list.get_size(); ++i)
+                done = has_thumbnail(i);
+
+            if (done || std::chrono::steady_clock::now() - start > std::chrono::seconds(60))
+            {
+                loop->quit();
+                return false;
+            }
+
+            return true;
+        },
+        50);
+    loop->run();
+
+    CHECK(list.get_size() == ImageCount);
+    CHECK(widget.m_ListStore->children().size() == list.get_size());
+
+    size_t i{ 0 };
+    for (const auto& img : list)
+    {
+        const size_t n{ image_number(img->get_path()) };
+        CHECK(n == i);
+
+        auto it{ widget.m_ListStore->get_iter(std::to_string(i)) };
+        Glib::RefPtr<Gdk::Pixbuf> thumb;
+        if (it)
+            thumb = it->get_value(widget.m_Columns.pixbuf);
+
+        CHECK(thumb && thumb->get_height() == thumbnail_height(n));
+        ++i;
+    }
+
+    list.clear();
+    TempDir::get_instance().remove_dir(dir);
+    TempDir::get_instance().remove_dir(staging);
+
+    return TEST_RESULT();
+}
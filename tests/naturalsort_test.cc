@@ -0,0 +1,85 @@
+#include "naturalsort.h"
+#include "test.h"
+using namespace AhoViewer;
+
+#include <cstdlib>
+
+namespace
+{
+    // The comparator NaturalSort used before it had keys, with the chars it compared
+    // spelled out as signed chars. Bytes of UTF-8 sequences are negative there
+    bool compare_natural(const char* a, const char* b)
+    {
+        auto digit = [](const char c) { return c >= '0' && c <= '9'; };
+        auto lower = [](const char c) {
+            const signed char s{ static_cast<signed char>(c) };
+            return s < 0 ? static_cast<int>(s) : std::tolower(s);
+        };
+
+        if (digit(*a) && digit(*b))
+        {
+            char *a_after, *b_after;
+            unsigned long a_l = strtoul(a, &a_after, 10), b_l = strtoul(b, &b_after, 10);
+
+            if (a_l != b_l)
+                return a_l < b_l;
+
+            return compare_natural(a_after, b_after);
+        }
+
+        if (digit(*a) || digit(*b))
+            return digit(*a);
+
+        while (*a && *b)
+        {
+            if (digit(*a) || digit(*b))
+                return compare_natural(a, b);
+
+            if (lower(*a) != lower(*b))
+                return lower(*a) < lower(*b);
+
+            ++a;
+            ++b;
+        }
+
+        return !!*a;
+    }
+}
+
+// Comparing keys has to give the same order the old comparator did, including for
+// names with UTF-8 in them
+int main()
+{
+    const std::vector<std::string> names{
+        "a",          "A",          "b",          "B",         "ab",          "abc",
+        "a1",         "a2",         "a10",        "a01",       "a1b",         "a1a",
+        "1",          "2",          "10",         "02",        "0",           "",
+        "_",          "~",          "Z",          "z",         "[",           "`",
+        "é",          "e",          "f",          "ë",         "日本",        "日本2",
+        "日本10",     "日本1a",     "ü1",         "u1",        "Ünicode",     "unicode",
+        "émile 2",    "émile 10",   "Émile 3",    "chapter 1", "chapter ü",   "chapter z",
+        "\x7f",       "a\x7f",      "a\x7f" "b",  "abc\xff",   "abc\x80",     "x\xc3\xa9y",
+        "x\xe2\x82\xac" "y",        "page 9.png", "page 10.png",
+    };
+
+    for (const std::string& a : names)
+    {
+        for (const std::string& b : names)
+        {
+            const bool expected{ compare_natural(a.c_str(), b.c_str()) },
+                actual{ NaturalSort::make_key(a) < NaturalSort::make_key(b) };
+
+            if (expected != actual)
+                std::cerr << "'" << a << "' < '" << b << "' should be " << expected << std::endl;
+            CHECK(expected == actual);
+        }
+    }
+
+    std::vector<std::string> sorted{ names };
+    NaturalSort::sort(sorted);
+    CHECK(std::is_sorted(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return compare_natural(a.c_str(), b.c_str());
+    }));
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <iostream>
+
+// Minimal checks for the tests, a failed check is reported and the test keeps going
+namespace AhoViewer::Test
+{
+    inline int failures{ 0 };
+}
+
+#define CHECK(cond)                                                                           \
+    do                                                                                        \
+    {                                                                                         \
+        if (!(cond))                                                                          \
+        {                                                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+            ++AhoViewer::Test::failures;                                                      \
+        }                                                                                     \
+    } while (0)
+
+#define TEST_RESULT() (AhoViewer::Test::failures == 0 ? 0 : 1)
@@ -0,0 +1,68 @@
+#include "test.h"
+#include "uidispatcher.h"
+using namespace AhoViewer;
+
+#include <chrono>
+#include <glibmm.h>
+#include <thread>
+
+// A worker emitting far more often than the mailbox drains should only wake the main
+// loop up to 60 times a second, and its last emit must still reach the handler
+int main()
+{
+    using namespace std::chrono;
+    constexpr size_t Emits{ 2000 };
+
+    auto loop{ Glib::MainLoop::create() };
+    UIDispatcher dispatcher;
+    size_t handled{ 0 };
+    std::atomic<bool> done{ false };
+
+    dispatcher.connect([&]() { ++handled; });
+
+    const auto before{ UIMailbox::get_instance().get_stats() };
+    const auto start{ steady_clock::now() };
+
+    std::thread worker{ [&]() {
+        for (size_t i = 0; i < Emits; ++i)
+        {
+            dispatcher.emit();
+            std::this_thread::sleep_for(microseconds(250));
+        }
+        done = true;
+    } };
+
+    // Give the last emit time to be drained after the worker is done
+    steady_clock::time_point finished;
+    Glib::signal_timeout().connect(
+        [&]() {
+            if (done && finished == steady_clock::time_point{})
+                finished = steady_clock::now();
+            if (finished != steady_clock::time_point{} &&
+                steady_clock::now() - finished > milliseconds(100))
+            {
+                loop->quit();
+                return false;
+            }
+            return true;
+        },
+        10);
+    loop->run();
+    worker.join();
+
+    const double seconds{ duration<double>(steady_clock::now() - start).count() };
+    const auto after{ UIMailbox::get_instance().get_stats() };
+    const size_t emits{ after.emits - before.emits },
+        dispatches{ after.dispatches - before.dispatches },
+        wakeups{ after.wakeups - before.wakeups };
+
+    std::cout << emits << " emits, " << dispatches << " dispatches, " << wakeups
+              << " wakeups in " << seconds << "s" << std::endl;
+
+    CHECK(emits == Emits);
+    CHECK(dispatches == handled);
+    CHECK(handled > 0 && handled < Emits);
+    CHECK(wakeups <= static_cast<size_t>(seconds * 60) + 2);
+
+    return TEST_RESULT();
+}